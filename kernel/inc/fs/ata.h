@@ -30,6 +30,18 @@
 #define ATA_REG_ALTSTATUS 0x0C
 #define ATA_REG_DEVADDRESS 0x0D
 
+#define ATA_CONTROL_NIEN 0x02
+
+// Bus master IDE registers of the primary channel, relative to BAR4
+#define ATA_BM_COMMAND 0x00
+#define ATA_BM_STATUS 0x02
+#define ATA_BM_PRDT 0x04
+
+#define ATA_BM_CMD_START 0x01
+#define ATA_BM_CMD_READ 0x08            // Direction, set when the device writes to memory
+#define ATA_BM_STATUS_ERROR 0x02
+#define ATA_BM_STATUS_IRQ 0x04
+
 #define ATA_CHANNEL_PRIMARY 0x1F7
 #define ATA_CHANNEL_SECONDARY 0x177
 #define ATA_PRIMARY_CONTROL 0x3F6
@@ -38,7 +50,34 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <fs/blk.h>
+
+// Physical region descriptor, a region may not cross a 64 KiB boundary
+typedef struct {
+    uint32_t address;
+    uint16_t size;                      // 0 means 64 KiB
+    uint16_t flags;
+} __attribute__((packed)) ata_prd_t;
+
+#define ATA_PRD_END 0x8000
+#define ATA_PRD_PAGES 1
+#define ATA_PRD_MAX (ATA_PRD_PAGES * 4096 / sizeof(ata_prd_t))
+
+// The sector count register is 8 bits wide, a count of 0 means 256
+#define ATA_MAX_SECTORS 256
+
+// Primary master, requests go through its queue
+extern struct blk_device ata_disk;
+// Set by ata_init when a bus master IDE controller was found, PIO is the fallback otherwise
+extern bool ata_dma;
+// Sectors per DRQ block of PIO transfers, more than 1 once ata_init set up READ/WRITE MULTIPLE
+extern uint32_t ata_multiple;
+// Size of the primary master in sectors from IDENTIFY, 0 if no drive answered
+extern uint32_t ata_sectors;
 
+// Finds the bus master registers and hooks up IRQ 14. From then on commands complete by interrupt and the
+// submitting task sleeps meanwhile, before that they are polled.
 void ata_init();
-void ata_read_sectors_pio(uint8_t *target_address, uint32_t LBA, uint8_t sector_count);
-void ata_write_sectors_pio(uint32_t LBA, uint8_t sector_count, uint8_t *rawBytes);
+// Any count, blk_rw cuts it into commands of at most ATA_MAX_SECTORS
+void ata_read_sectors_pio(uint8_t *target_address, uint32_t LBA, uint32_t sector_count);
+void ata_write_sectors_pio(uint32_t LBA, uint32_t sector_count, uint8_t *rawBytes);
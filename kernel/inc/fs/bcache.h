@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <fs/blk.h>
+#include <lru.h>
+
+// Sector sized buffers shared by every block device, recycled least recently used first
+#define BCACHE_BUFFERS 128
+#define BCACHE_BUCKETS 64
+// Sectors one bcache_read or bcache_sync pass keeps pinned and in flight
+#define BCACHE_BATCH 16
+
+struct bcache_buffer {
+    struct blk_device *dev;             // nullptr while the buffer holds nothing
+    uint32_t lba;
+    bool valid;                         // data holds the sector
+    bool dirty;                         // Written since it was last stored
+    bool busy;                          // A read or write of data is in flight, wait before touching it
+    bool failed;                        // The last I/O on the buffer failed
+    uint32_t pins;                      // Users, pinned buffers are never recycled
+    struct bcache_buffer *hash_next;
+    struct lru_link lru;
+    uint8_t data[BLK_SECTOR_SIZE];
+};
+
+// Copies through the cache, the sectors missing from it are read with as few commands as the queue can merge them into
+bool bcache_read(struct blk_device *dev, uint32_t lba, uint32_t count, uint8_t *buffer);
+// Write-back, the sectors reach the disk on bcache_sync or when their buffers are recycled
+bool bcache_write(struct blk_device *dev, uint32_t lba, uint32_t count, const uint8_t *buffer);
+// Stores every dirty buffer of `dev`, or of every device for nullptr, adjacent sectors go out as one write
+bool bcache_sync(struct blk_device *dev);
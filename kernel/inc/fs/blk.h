@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <proc/spinlock.h>
+
+#define BLK_SECTOR_SIZE 512
+// Bios blk_rw keeps in flight at once, they live on its stack
+#define BLK_RW_BATCH 8
+
+enum blk_op {
+    BLK_READ,
+    BLK_WRITE
+};
+
+struct blk_bio;
+
+// What a driver is handed, one or more adjacent bios that go out as a single command
+struct blk_request {
+    struct blk_request *next;           // Queue link, the queue is sorted by LBA
+    enum blk_op op;
+    uint32_t lba;
+    uint32_t count;                     // Sectors over all bios
+    struct blk_bio *bios;               // In LBA order, back to back on the disk
+    struct blk_bio *last_bio;
+};
+
+// A transfer as it is submitted, one buffer of `count` sectors. It stays owned by the block layer until `end` ran.
+struct blk_bio {
+    struct blk_bio *next;               // Next bio of the same request
+    enum blk_op op;
+    uint32_t lba;
+    uint32_t count;
+    uint8_t *buffer;
+    void (*end)(struct blk_bio *, bool ok); // Completion, runs wherever the driver finishes, IRQ context included
+    void *private;
+
+    struct blk_request request;         // Used when the bio starts a request of its own, so queueing never allocates
+};
+
+struct blk_device {
+    const char *name;
+    uint32_t max_sectors;               // Largest request the driver takes, merging stops there
+    // Starts the request, the driver calls blk_end_request once it is done, from inside start if it is synchronous
+    void (*start)(struct blk_device *, struct blk_request *);
+    void *private;
+
+    spinlock_t lock;
+    struct blk_request *queue;          // Waiting for the driver
+    struct blk_request *active;         // With the driver, one at a time
+    uint32_t head;                      // LBA right after the last dispatched request, C-LOOK sweeps up from here
+    uint32_t plugged;
+    bool dispatching;
+
+    uint32_t submitted;                 // Bios
+    uint32_t merged;                    // Bios that joined a waiting request instead of making their own
+    uint32_t dispatched;                // Requests handed to the driver
+};
+
+// Queues the bio, joining it to a waiting request it continues or precedes. bio->count must not exceed max_sectors.
+// Overlapping bios aren't ordered against each other, a caller reading what it is writing waits for the write first.
+void blk_submit(struct blk_device *dev, struct blk_bio *bio);
+// Holds dispatch back so a batch of bios can merge, the last unplug starts whatever piled up
+void blk_plug(struct blk_device *dev);
+void blk_unplug(struct blk_device *dev);
+// Driver side, completes every bio of the request and starts the next one
+void blk_end_request(struct blk_device *dev, struct blk_request *request, bool ok);
+
+// Reads or writes `count` sectors of any length and sleeps until they are done
+bool blk_rw(struct blk_device *dev, enum blk_op op, uint32_t lba, uint32_t count, uint8_t *buffer);
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <proc/vfs.h>
+#include <fs/blk.h>
+
+#define VFS_BLOCK_DEVICE 3
+
+// A whole block device as a file, its data is read and written through the page cache. Pages are filled from
+// and written back through the buffer cache the partitions use, so both agree on every sector once it leaves the
+// page cache. A page already cached still misses partition writes made after it was read in.
+struct vfs_blkdev_node {
+    struct vfs_node base;
+    struct blk_device *dev;
+};
+
+// Adds `name` under `parent`, `sectors` long and unable to grow. Writes reach the disk when their pages are
+// evicted, on the node's last close or on sync().
+struct vfs_node *blkdev_create(struct vfs_node *parent, const char *name, struct blk_device *dev, uint32_t sectors);
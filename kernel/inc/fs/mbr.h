@@ -33,5 +33,7 @@ extern partition_t mbr[4];
 extern uint8_t boot_mbr;
 
 void mbr_parse();
+// Reads and writes go through the buffer cache, writes reach the disk on mbr_sync or when their buffers are recycled
 bool mbr_read_sector(partition_t* disk, uint32_t lba, uint8_t sectors, uint8_t* buffer);
 bool mbr_write_sector(partition_t* disk, uint32_t lba, uint8_t sectors, uint8_t* buffer);
+bool mbr_sync();
@@ -9,12 +9,19 @@ uint8_t inb(uint16_t port);
 uint16_t inw(uint16_t port);
 uint32_t inl(uint16_t port);
 
+// Move `count` words between `buffer` and the port with rep insw / rep outsw
+void insw(uint16_t port, void *buffer, uint32_t count);
+void outsw(uint16_t port, const void *buffer, uint32_t count);
+
 void cli();
 void sti();
 void hlt();
 
 int is_interrupts_enabled();
 
+// TSC ticks per second, 0 until the local APIC timer calibration measured it
+extern uint64_t tsc_frequency;
+uint64_t rdtsc();
 uint64_t read_msr(uint32_t msr);
 void write_msr(uint32_t msr, uint64_t value);
 
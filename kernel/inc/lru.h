@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Intrusive recency list and the (owner, index) hash the page and buffer caches index their entries by.
+// Nothing here locks, the cache embedding it does.
+struct lru_link {
+    struct lru_link *prev;              // Toward the most recently used end
+    struct lru_link *next;
+};
+
+struct lru_list {
+    struct lru_link *head;              // Most recently used
+    struct lru_link *tail;
+};
+
+// Structure embedding the link
+#define lru_entry(link, type, member) ((type *)((char *)(link) - offsetof(type, member)))
+
+static inline void lru_unlink(struct lru_list *list, struct lru_link *link) {
+    if (link->prev) link->prev->next = link->next;
+    else list->head = link->next;
+    if (link->next) link->next->prev = link->prev;
+    else list->tail = link->prev;
+    link->prev = link->next = nullptr;
+}
+
+static inline void lru_push(struct lru_list *list, struct lru_link *link) {
+    link->prev = nullptr;
+    link->next = list->head;
+    if (list->head) list->head->prev = link;
+    else list->tail = link;
+    list->head = link;
+}
+
+// Moves a linked entry to the most recently used end
+static inline void lru_touch(struct lru_list *list, struct lru_link *link) {
+    lru_unlink(list, link);
+    lru_push(list, link);
+}
+
+// `buckets` is a power of two
+static inline uint32_t lru_hash(const void *owner, uint32_t index, uint32_t buckets) {
+    return (((uintptr_t)owner >> 4) ^ (index * 2654435761u)) & (buckets - 1);
+}
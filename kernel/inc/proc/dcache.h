@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <proc/vfs.h>
+
+// Direct mapped, a path hashing to a taken slot replaces what was there
+#define VFS_DCACHE_ENTRIES 256
+// Longer paths are looked up every time
+#define VFS_DCACHE_PATH_MAX 112
+
+struct vfs_dentry {
+    struct vfs_tree *tree;
+    uint32_t hash;                      // vfs_hash_name of the path
+    uint32_t generation;                // vfs_dcache_generation when the entry was filled
+    struct vfs_node *node;
+    char path[VFS_DCACHE_PATH_MAX];
+};
+
+// Node cached for `path`, nullptr on a miss
+struct vfs_node *vfs_dcache_lookup(struct vfs_tree *tree, const char *path, uint32_t hash);
+// `generation` is the one read before the walk started, a walk that raced with a removal is never cached
+void vfs_dcache_insert(struct vfs_tree *tree, const char *path, uint32_t hash, uint32_t generation, struct vfs_node *node);
+uint32_t vfs_dcache_generation();
+// Drops every entry at once, called whenever a node goes away or the namespace changes shape
+void vfs_dcache_invalidate();
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+#include <proc/task.h>
+
+#define ELF_MAGIC 0x464C457F            // "\x7FELF" read as a little endian word
+#define ELF_CLASS_32 1
+#define ELF_DATA_LSB 1
+#define ELF_TYPE_EXEC 2
+#define ELF_MACHINE_386 3
+
+#define ELF_PT_LOAD 1
+#define ELF_PF_X 0x1
+#define ELF_PF_W 0x2
+#define ELF_PF_R 0x4
+
+#define ELF_MAX_PHDRS 16
+#define ELF_MAX_ARGS 16
+
+typedef struct {
+    uint32_t magic;
+    uint8_t class;
+    uint8_t data;
+    uint8_t version;
+    uint8_t pad[9];
+    uint16_t type;
+    uint16_t machine;
+    uint32_t version2;
+    uint32_t entry;
+    uint32_t phoff;
+    uint32_t shoff;
+    uint32_t flags;
+    uint16_t ehsize;
+    uint16_t phentsize;
+    uint16_t phnum;
+    uint16_t shentsize;
+    uint16_t shnum;
+    uint16_t shstrndx;
+} __attribute__((packed)) elf32_ehdr_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t offset;
+    uint32_t vaddr;
+    uint32_t paddr;
+    uint32_t filesz;
+    uint32_t memsz;
+    uint32_t flags;
+    uint32_t align;
+} __attribute__((packed)) elf32_phdr_t;
+
+// Installs the page fault handler that pulls segments in on first touch
+void elf_init();
+// Maps the page at `address` with whatever of the task's segments covers it, false if none does or the read failed.
+// Runs with interrupts enabled, the read may sleep.
+bool elf_fault_in(struct task *task, uint32_t address);
+// Builds a ring 3 task for the executable at `path`, its stack starts with argc, argv and an empty envp.
+// Nothing of the image is read until the task touches it. The task still has to be passed to sched_add_task.
+struct task *elf_exec(const char *path, int argc, const char **argv, uint32_t ppid);
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <proc/vfs.h>
+#include <proc/mutex.h>
+#include <stdint.h>
+
+struct task;
+
+// Open flags
+#define VFS_O_READ      0x1
+#define VFS_O_WRITE     0x2
+#define VFS_O_APPEND    0x4             // Every write goes to the end of the file, whatever the offset
+#define VFS_O_CREATE    0x8             // Create a missing file instead of failing
+
+#define VFS_SEEK_SET    0
+#define VFS_SEEK_CUR    1
+#define VFS_SEEK_END    2
+
+// An open file description, the state one open() call sets up and every fd duplicated from it shares
+struct vfs_file {
+    HANDLE node;                        // Holds a reference, the node outlives a removal as long as this is open
+    vfs_off_t offset;                   // Where the next read or write continues
+    uint32_t flags;                     // VFS_O_*
+    uint32_t refcount;                  // fds (and anything else) sharing the description
+    mutex_t lock;                       // Keeps the offset in step with the I/O done at it
+};
+
+// Opens `path` with VFS_O_* flags, nullptr if it doesn't exist (and couldn't be created) or isn't a file
+struct vfs_file *vfs_file_open(const char *path, uint32_t flags);
+struct vfs_file *vfs_file_get(struct vfs_file *file);
+// Drops a reference, the last one closes the node
+void vfs_file_put(struct vfs_file *file);
+
+// These continue at the file's offset and move it past what they transferred, -1 on errors or a missing open flag.
+// Reads return 0 at the end of the file, see preadv/pwritev for the rest.
+int64_t vfs_file_readv(struct vfs_file *file, const struct vfs_iovec *iov, uint32_t count);
+int64_t vfs_file_writev(struct vfs_file *file, const struct vfs_iovec *iov, uint32_t count);
+int64_t vfs_file_read(struct vfs_file *file, void *buffer, size_t size);
+int64_t vfs_file_write(struct vfs_file *file, const void *buffer, size_t size);
+// Returns the new offset, -1 if it would end up negative or past `max`, the offset is left alone then
+int64_t vfs_file_seek(struct vfs_file *file, int64_t offset, int whence, int64_t max);
+
+// Per-task fd table. Only the task itself and, once it is gone, the reaper touch it, so there is no lock.
+// Stores the reference the caller passes in, returns the lowest free fd from `first` on or -1 when the table is full
+int fd_install(struct task *task, struct vfs_file *file, int first);
+// Borrowed, valid until the fd is closed
+struct vfs_file *fd_get(struct task *task, int fd);
+int fd_close(struct task *task, int fd);
+void fd_close_all(struct task *task);
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <proc/vfs.h>
+
+// Name of the Ultra module hyper.cfg loads the archive as
+#define INITRAMFS_MODULE_NAME "initramfs"
+#define USTAR_BLOCK_SIZE 512
+#define USTAR_ROUND_UP(size) (((size) + USTAR_BLOCK_SIZE - 1) & ~(USTAR_BLOCK_SIZE - 1))
+// prefix, a slash, name and the terminator
+#define USTAR_PATH_MAX (155 + 1 + 100 + 1)
+
+typedef struct {
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char checksum[8];
+    char type;
+    char linkname[100];
+    char magic[6];                      // "ustar" followed by a NUL
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155];
+    char pad[12];
+} __attribute__((packed)) ustar_header_t;
+
+#define USTAR_TYPE_FILE '0'
+#define USTAR_TYPE_FILE_OLD '\0'
+#define USTAR_TYPE_DIRECTORY '5'
+
+// Remembers where the bootloader put the archive, _start calls this while it walks the boot attributes
+void initramfs_set_module(const void *archive, size_t size);
+// Creates every directory and regular file of the archive under `root`, returns how many files it added or -1 without an archive
+int initramfs_unpack(struct vfs_node *root);
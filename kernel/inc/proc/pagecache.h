@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <proc/vfs.h>
+#include <lru.h>
+
+// File data of nodes with a readpage op is kept here, keyed by (node, page index), see fs/blkdev.h for one.
+// ramfs doesn't take part, its chunks already are page frames and caching them would only double them.
+#define PAGECACHE_PAGE_SIZE 4096
+#define PAGECACHE_BUCKETS 256
+// The cache recycles its own least recently used pages once it holds 1/PAGECACHE_MAX_SHARE of physical memory
+#define PAGECACHE_MAX_SHARE 4
+// A writer that leaves more dirty pages than this in the cache writes all of them back before returning
+#define PAGECACHE_DIRTY_LIMIT 256
+// Dirty pages pinned and written per pass of pagecache_writeback
+#define PAGECACHE_WRITEBACK_BATCH 16
+
+struct cached_page {
+    struct vfs_node *node;
+    uint32_t index;                     // Offset in the file / PAGECACHE_PAGE_SIZE
+    uint8_t *data;                      // The page frame through the higher half, zeros past the end of the file
+    bool dirty;                         // Written since the last writepage
+    uint32_t pins;                      // Copies in flight, pinned pages are never evicted
+    struct cached_page *hash_next;      // Bucket chain, free list link once evicted
+    struct lru_link lru;
+};
+
+void pagecache_init();
+
+// Called by preadv/pwritev for nodes with readpage, same contract as those
+int64_t pagecache_readv(struct vfs_node *node, vfs_off_t offset, const struct vfs_iovec *iov, uint32_t count);
+int64_t pagecache_writev(struct vfs_node *node, vfs_off_t offset, const struct vfs_iovec *iov, uint32_t count);
+
+// Hands the node's dirty pages to its writepage op, nullptr writes back every node. False if one of them failed,
+// that page stays dirty.
+bool pagecache_writeback(struct vfs_node *node);
+static inline bool pagecache_sync() {
+    return pagecache_writeback(nullptr);
+}
+// Forgets the node's pages, dirty or not, for nodes that are being freed. Sleeps until pinned ones are let go.
+void pagecache_invalidate(struct vfs_node *node);
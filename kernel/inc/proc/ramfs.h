@@ -4,10 +4,17 @@
 
 #define VFS_RAMFS_FILE 1
 #define VFS_RAMFS_FOLDER 2
+// File data lives in page sized chunks, one page frame each
+#define RAMFS_CHUNK_SIZE 4096
 
 struct vfs_ramfs_node {
     struct vfs_node base;
 
-    uint8_t* data;          // nullptr if size is 0 !!!!!
+    uint8_t** chunks;       // RAMFS_CHUNK_SIZE pieces of the file in order, nullptr entries are holes reading as zeros
+    uint32_t chunk_slots;   // Capacity of chunks, not every slot is below the file size
+    const uint8_t* backing; // Immutable buffer the file reads from until its first write, no chunks meanwhile
 };
 
+// Makes `file` read `size` bytes straight out of `buffer`, which has to outlive the node. The first write copies it.
+vfs_err_t ramfs_attach(struct vfs_node* file, const uint8_t* buffer, uint32_t size);
+
@@ -1,19 +1,87 @@
 #pragma once
 
 #include <proc/task.h>
+#include <proc/spinlock.h>
 #include <sys/idt.h>
+#include <sys/smp.h>
 #include <stdint.h>
 
-extern struct task *current_task;
+#define SCHED_YIELD_VECTOR 0x30
+// Tick rate of the per-CPU APIC timers, the PIT fallback keeps its power-on rate
+#define SCHED_HZ 1000
+
+// Policy task_create gives new tasks, SCHED_RR brings back plain round-robin for everything
+#define SCHED_DEFAULT_POLICY SCHED_FAIR
+// Fair class weight of a task with priority 0, a task with priority 2048 gets twice its share
+#define SCHED_NICE_0_WEIGHT 1024
+#define SCHED_FAIR_GRANULARITY_MS 4
+// Deadline bandwidth is runtime / period in 1/SCHED_DL_UNIT, a CPU admits up to SCHED_DL_UTIL_LIMIT percent
+#define SCHED_DL_UNIT 1024
+#define SCHED_DL_UTIL_LIMIT 95
+// FIFO tasks of a CPU run for at most SCHED_RT_RUNTIME_US of every SCHED_RT_PERIOD_US together, so one that spins
+// can't starve the reaper and the shell
+#define SCHED_RT_PERIOD_US 1000000
+#define SCHED_RT_RUNTIME_US 950000
+
+// Task running on the calling CPU
+struct task *sched_current();
+#define current_task (sched_current())
 
 int get_pid();
 void sched_init(struct task *callback_task);
+// Gives an application processor its idle task, the first reschedule IPI then starts running tasks on it
+void sched_init_cpu(struct cpu *cpu);
 
+// All of these only before the task is added
+void sched_set_policy(struct task *task, enum sched_policy policy);
+void sched_set_fifo(struct task *task, uint32_t rt_priority);
+// Reserves runtime_us of every period_us on one CPU, false if no CPU has that much deadline bandwidth left
+bool sched_set_deadline(struct task *task, uint32_t runtime_us, uint32_t period_us);
+// Places the task on the least loaded CPU, idle CPUs steal from the others as well
 void sched_add_task(struct task *new_task);
-void sched_remove_task(uint32_t pid);
+
+// Marks the current task terminated and never returns, the reaper frees it once the parent has collected the exit code
+[[noreturn]] void task_exit(int code);
+// Blocks until a child (or the child with `pid`, 0 = any) exits, returns its pid or -1 if there is no such child
+int sched_wait(uint32_t pid, int *exit_code);
+
+void sched_block();
+void sched_wake(struct task *task);
+// Blocks the current task for at least `ms` milliseconds
+void sched_sleep(uint32_t ms);
+
+// Tasks sleeping on a condition, protected by whatever lock guards that condition
+struct wait_queue {
+    struct task *head;
+};
+
+// Sleeps until woken, `lock` is held by the caller with interrupts disabled, dropped while asleep and taken again before returning
+void sched_sleep_on(struct wait_queue *queue, spinlock_t *lock);
+// Both must be called with the queue's lock held
+void sched_wake_one(struct wait_queue *queue);
+void sched_wake_all(struct wait_queue *queue);
+
+// Copy of a task's accounting, see sched_snapshot
+struct task_info {
+    uint32_t pid;
+    uint32_t ppid;
+    enum task_state state;
+    enum sched_policy policy;
+    bool idle;                          // One of the per-CPU idle tasks
+    uint32_t last_cpu;
+    uint64_t user_cycles;
+    uint64_t kernel_cycles;
+    uint32_t voluntary_switches;
+    uint32_t involuntary_switches;
+    uint32_t wakeups;
+};
+
+// Fills `out` with up to `max` tasks, idle tasks included, and returns how many there were.
+// The counters are read without the run queue locks, a running task may be one tick ahead.
+uint32_t sched_snapshot(struct task_info *out, uint32_t max);
 
 void timer_interrupt_handler(registers_t* regs);
 
 static inline void yield() {
-    __asm__ volatile ("int $0x20");
+    __asm__ volatile ("int %0" : : "i"(SCHED_YIELD_VECTOR));
 }
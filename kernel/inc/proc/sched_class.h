@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <rbtree.h>
+#include <proc/spinlock.h>
+
+struct task;
+
+// Everything a CPU can pick from, the running task itself is never queued
+struct run_queue {
+    spinlock_t lock;
+    uint32_t nr_queued;
+
+    // deadline class, ordered by absolute deadline, tasks out of budget wait on dl_throttled until their next period
+    struct rb_tree dl_timeline;
+    struct task *dl_throttled;
+    uint32_t dl_bandwidth;              // Admitted runtime / period of the CPU's deadline tasks, in SCHED_DL_UNIT
+
+    // FIFO class, highest rt_priority first, first come first served within a priority
+    struct rb_tree rt_queue;
+    uint64_t rt_period_start;           // TSC, see SCHED_RT_PERIOD_US
+    uint64_t rt_time;                   // FIFO runtime charged since rt_period_start
+    bool rt_throttled;                  // Used up SCHED_RT_RUNTIME_US, the classes below run until the period ends
+
+    // round-robin class, FIFO through task->rq_next
+    struct task *rr_head;
+    struct task *rr_tail;
+
+    // fair class, ordered by vruntime
+    struct rb_tree fair_timeline;
+    uint64_t min_vruntime;              // Never goes backwards, new and waking tasks are placed relative to it
+};
+
+#define ENQUEUE_NEW     0x1             // First time the task runs anywhere
+#define ENQUEUE_WAKEUP  0x2             // Coming back from a block or wait
+#define ENQUEUE_PREEMPTED 0x4           // Lost the CPU involuntarily, FIFO tasks keep their place in line
+
+// One per scheduling policy, all called with the run queue lock held
+struct sched_class {
+    void (*enqueue)(struct run_queue *rq, struct task *task, int flags);
+    // Removes and returns the task that should run next, nullptr if the class has nothing queued
+    struct task *(*pick_next)(struct run_queue *rq);
+    // Charges `delta` TSC cycles of CPU time to the running task
+    void (*update_curr)(struct run_queue *rq, struct task *curr, uint64_t delta);
+    bool (*has_queued)(struct run_queue *rq);
+    // Whether a queued task of the same class should take over from `curr` on a tick
+    bool (*should_preempt)(struct run_queue *rq, struct task *curr);
+    // Whether the freshly woken `task` should take over from `curr`, both of this class
+    bool (*wakeup_preempt)(struct task *task, struct task *curr);
+    // Runs on every reschedule of the CPU, whatever class the current task has
+    void (*tick)(struct run_queue *rq, uint64_t now);
+    // `curr` gave up the CPU on purpose, called before it is queued again
+    void (*yield)(struct run_queue *rq, struct task *curr);
+    // Removes and returns a queued task no CPU is running on, for another CPU to take
+    struct task *(*steal)(struct run_queue *rq);
+    // Adjusts a stolen task before it runs on the queue `to`
+    void (*migrate)(struct run_queue *from, struct run_queue *to, struct task *task);
+};
+
+// Without a calibrated TSC this assumes 1GHz
+uint64_t sched_us_to_cycles(uint64_t us);
+
+extern const struct sched_class dl_sched_class;
+extern const struct sched_class rt_sched_class;
+extern const struct sched_class fair_sched_class;
+extern const struct sched_class rr_sched_class;
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SCHED_TRACE_EVENTS      1024    // Per CPU, a power of two
+#define SCHED_TRACE_BUCKETS     32      // log2(cycles) histogram buckets
+
+enum sched_trace_type {
+    TRACE_SWITCH_IN,                    // arg = pid of the task switched out
+    TRACE_SWITCH_OUT,                   // arg = state the task is left in
+    TRACE_WAKEUP,                       // arg = CPU that woke it
+    TRACE_BLOCK,                        // arg = state (blocked or waiting)
+    TRACE_IRQ_ENTRY,                    // arg = vector
+    TRACE_IRQ_EXIT,                     // arg = vector
+};
+
+struct sched_trace_event {
+    uint64_t tsc;
+    uint32_t pid;
+    uint16_t arg;
+    uint8_t type;
+    uint8_t cpu;
+};
+
+struct task;
+
+extern bool sched_trace_enabled;
+
+// Appends to the calling CPU's ring, each ring has a single writer so recording takes no lock
+void sched_trace(enum sched_trace_type type, uint32_t pid, uint16_t arg);
+// Records the switch and feeds the run queue wait and time slice histograms, called with interrupts disabled
+void sched_trace_switch(struct task *prev, struct task *next);
+// Resets the histograms and drops every event recorded so far from the next dump
+void sched_trace_clear();
+
+// Both hand out one line at a time, `out` may be called many times
+void sched_trace_dump(void (*out)(const char *line, void *arg), void *arg);
+void sched_trace_histograms(void (*out)(const char *line, void *arg), void *arg);
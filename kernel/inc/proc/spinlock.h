@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct spinlock {
+    volatile int locked;
+} spinlock_t;
+
+#define SPINLOCK_INIT { 0 }
+
+static inline void spin_init(spinlock_t *lock) {
+    lock->locked = 0;
+}
+
+// Disables interrupts and spins, the returned eflags go back into spin_unlock_irqrestore
+static inline uint32_t spin_lock_irqsave(spinlock_t *lock) {
+    uint32_t flags;
+    __asm__ volatile ("pushf\n" "pop %0\n" "cli" : "=r"(flags) : : "memory");
+    while (__sync_lock_test_and_set(&lock->locked, 1)) {
+        while (lock->locked) __asm__ volatile ("pause");
+    }
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t *lock, uint32_t flags) {
+    __sync_lock_release(&lock->locked);
+    if (flags & 0x200) __asm__ volatile ("sti" : : : "memory");
+}
+
+static inline uint32_t irq_save() {
+    uint32_t flags;
+    __asm__ volatile ("pushf\n" "pop %0\n" "cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint32_t flags) {
+    if (flags & 0x200) __asm__ volatile ("sti" : : : "memory");
+}
+
+// For code already running with interrupts disabled (IRQ handlers, the scheduler)
+static inline void spin_lock(spinlock_t *lock) {
+    while (__sync_lock_test_and_set(&lock->locked, 1)) {
+        while (lock->locked) __asm__ volatile ("pause");
+    }
+}
+
+static inline void spin_unlock(spinlock_t *lock) {
+    __sync_lock_release(&lock->locked);
+}
+
+static inline bool spin_trylock(spinlock_t *lock) {
+    return __sync_lock_test_and_set(&lock->locked, 1) == 0;
+}
@@ -2,12 +2,37 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 #include <sys/gdt.h>
 #include <kheap.h>
 #include <string.h>
 #include <sys/mm/vmm.h>
+#include <rbtree.h>
+#include <proc/vfs.h>
 
-#define STACK_SIZE 0x1000
+struct vfs_file;
+
+#define STACK_SIZE 0x4000
+// User stacks grow down from just below the kernel half, one guard page is left unmapped under the kernel
+#define USER_STACK_TOP 0xBFFFF000
+#define USER_STACK_SIZE 0x10000
+#define TASK_MAX_FILES 16
+
+enum sched_policy {
+    SCHED_DEADLINE,                     // Earliest deadline first within an admitted runtime per period
+    SCHED_FIFO,                         // Strict priority, runs until it blocks or yields
+    SCHED_FAIR,                         // Shares the CPU by weight, see priority
+    SCHED_RR,                           // Plain round-robin, only runs when no fair task is ready
+};
+
+// A PT_LOAD segment of the task's executable, its pages are read in when first touched
+struct user_segment {
+    uint32_t vaddr;
+    uint32_t memsz;
+    uint32_t offset;                    // Where the file part starts in the image
+    uint32_t filesz;                    // Anything past this up to memsz is zero filled
+    bool writable;
+};
 
 enum task_state {
     TASK_RUNNING,
@@ -18,47 +43,64 @@ enum task_state {
 };
 
 struct task {
-    struct task *next;                  // linked list baby
+    struct task *next;                  // linked list baby (task list, or zombie list once terminated)
+    struct task *wait_next;             // Link in the wait_queue the task sleeps on
+    struct task *rq_next;               // Link in the round-robin queue
+    struct rb_node run_node;            // Link in the fair class timeline
 
     uint32_t pid;                       // Process ID
-    uint32_t ppid;                      // Parent Process ID
-    uint32_t priority;                  // Task priority
+    uint32_t ppid;                      // Parent Process ID, 0 if nobody is going to wait for us
+    uint32_t priority;                  // Fair class weight, 0 is the default weight (SCHED_NICE_0_WEIGHT)
     uint32_t nieche;                    // Default priority to which priority is reset when ran
     vmm_context_t cr3;                  // Pointer to the page directory of the task
-    uint32_t registers[7];              // General purpose registers (EAX, EBX, ECX, EDX, ESI, EDI, EBP)
-    uint16_t cs, ds, es, fs, gs, ss;    // Segment selectors
-    uint32_t eip;
-    uint32_t eflags;
-    uint32_t esp;                       // Userspace Stack pointer 
+    bool user;                          // Runs in ring 3, kernel_stack is only entered through the TSS
     bool fpu_enabled;                   // Is the FPU enabled for userspace tasks?
     uint8_t fpu_state[108];             // FPU/MMX state saved with 'fsave'
-    uint32_t kernel_esp;                // Kernel mode stack pointer (userspace shananigans)
-    
+    uintptr_t kernel_stack;             // Base of the kmalloc'd kernel stack, freed by the reaper
+    uint32_t kernel_esp;                // Saved interrupt frame (registers_t*) on the kernel stack
+
     enum task_state state;              // Current task state (running, ready, etc.)
+    uint32_t cpu;                       // CPU whose run queue holds the task
+    volatile bool on_cpu;               // Some CPU still runs on this task's stack, it can't be migrated or freed
+    uint64_t ready_tsc;                 // When the task last became READY, for the run queue wait histogram
+    uint64_t run_start_tsc;             // When the task was last switched in
 
-    //TODO: Vfs stuff
-};
+    enum sched_policy policy;
+    uint64_t vruntime;                  // TSC cycles run, scaled by SCHED_NICE_0_WEIGHT / weight
+    uint64_t exec_start;                // Last time the running task was charged
+
+    uint32_t rt_priority;               // SCHED_FIFO, higher goes first
+    uint64_t dl_runtime;                // SCHED_DEADLINE budget per period, TSC cycles
+    uint64_t dl_period;
+    uint64_t dl_deadline;               // Absolute, TSC
+    int64_t dl_budget;                  // Left in the current period
+    bool dl_throttled;                  // Used up its budget, waits for the next period
+    uint64_t wake_tsc;                  // sched_sleep deadline, TSC
+
+    // Accounting, charged on every tick and switch under the run queue lock
+    uint64_t user_cycles;               // TSC cycles of ticks that interrupted ring 3
+    uint64_t kernel_cycles;             // Everything else
+    uint32_t voluntary_switches;        // Gave up the CPU by blocking, sleeping or yielding
+    uint32_t involuntary_switches;      // Preempted while still runnable
+    uint32_t wakeups;                   // Times sched_wake made the task runnable again
+    uint32_t last_cpu;                  // CPU the task last ran on
 
-static inline uintptr_t setup_stack() {
-    uintptr_t stack = (uintptr_t)kmalloc(STACK_SIZE);
-    return stack + STACK_SIZE;
-}
+    uint32_t wait_pid;                  // Child we are blocked on in sched_wait (0 = any)
+    int exit_code;                      // Set by task_exit, handed to the parent by sched_wait
+
+    struct vfs_file *files[TASK_MAX_FILES]; // fd table, nullptr slots are free, see fd_install
+    HANDLE image;                       // Executable the segments are read from, nullptr for kernel tasks, holds a reference
+    struct user_segment *segments;
+    uint32_t segment_count;
+};
 
-static inline struct task task_create(uintptr_t callback, uint32_t pid, uint32_t ppid, uint32_t priority, vmm_context_t cr3) {
-    struct task new_task = {
-        .next = nullptr,
-        .pid = pid,
-        .ppid = ppid,
-        .priority = priority,
-        .nieche = priority,
-        .cr3 = cr3,
-        .registers = {0, 0, 0, 0, 0, 0, 0},
-        .cs = 0x08, .ds = 0x10, .es = 0x10, .fs = 0x00, .gs = 0x0 /* gs, fs are reserved */, .ss = 0x10, // all tasks start in kernel mode
-        .eip = callback, .eflags = 0x202, .esp = 0x00,
-        .fpu_enabled = false,
-        .fpu_state = {0},
-        .kernel_esp = setup_stack(),
-        .state = TASK_READY
-    };
-    return new_task;
-}
\ No newline at end of file
+// Allocates the task and its kernel stack, the task starts at `callback` and exits through task_exit when it returns
+struct task *task_create(uintptr_t callback, uint32_t ppid, uint32_t priority, vmm_context_t cr3);
+// Same as task_create, `callback` receives `arg` as its only parameter
+struct task *task_create_arg(uintptr_t callback, uintptr_t arg, uint32_t ppid, uint32_t priority, vmm_context_t cr3);
+// Ring 3 task entering `entry` with `user_esp`, `cr3` comes from vmm_create_pd and is owned by the task from now on
+struct task *task_create_user(uintptr_t entry, uintptr_t user_esp, uint32_t ppid, uint32_t priority, vmm_context_t cr3);
+// Maps a zeroed USER_STACK_SIZE stack below USER_STACK_TOP in `cr3`, returns the initial esp or 0 when out of memory
+uintptr_t task_map_user_stack(vmm_context_t *cr3);
+// Frees everything task_create (and later the loader) allocated, never call this on a task that can still run
+void task_destroy(struct task *task);
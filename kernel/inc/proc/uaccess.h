@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Everything the kernel reads from or writes to a task's memory goes through these, with interrupts enabled and
+// no lock held. Pages of the executable that weren't touched yet are read in first. Anything that isn't mapped
+// for ring 3 with the needed permission makes them return false instead of faulting.
+
+// Checks the range now, for when the copy itself has to wait
+bool user_access_ok(uint32_t address, uint32_t size, bool write);
+bool copy_from_user(void *dst, uint32_t src, uint32_t size);
+bool copy_to_user(uint32_t dst, const void *src, uint32_t size);
+// Copies a string of at most `max` bytes, terminator included
+bool copy_string_from_user(char *dst, uint32_t src, uint32_t max);
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
+#include <stddef.h>
 
 typedef enum {
     VFS_SUCCESS = 0,
@@ -16,24 +18,61 @@ typedef enum {
 
 typedef uint32_t vfs_node_type_t;
 typedef uint32_t vfs_permissions_t;
+typedef uint64_t vfs_off_t;
+
+// One buffer of a scatter/gather transfer, lays out the same as a user iovec
+struct vfs_iovec {
+    void *base;
+    size_t length;
+};
+
+// Most segments a single vectored call takes
+#define VFS_IOV_MAX 16
 
 struct vfs_node {
     vfs_node_type_t type;                // Type
     char *name;                          // Name of the file or directory
     vfs_permissions_t permissions;       // File permissions
-    uint32_t size;                       // Size of the file (0 for directories)
+    vfs_off_t size;                      // Size of the file (0 for directories)
+    bool fixed_size;                     // Writes past size fail instead of growing the file, block devices
     uint64_t creation_time;              // Creation timestamp
     uint64_t modification_time;          // Modification timestamp
 
     struct vfs_node *parent;             // Parent directory
-    struct vfs_node *children;           // Pointer to first child
+    struct vfs_node *children;           // Pointer to first child, siblings stay in creation order
     struct vfs_node *next;               // Pointer to next sibling
+    struct vfs_node *prev;               // Pointer to previous sibling
+    struct vfs_node *last_child;         // Tail of children, so inserting doesn't walk the list
+
+    // Directory index, children hashed by name next to the ordered list
+    uint32_t name_hash;                  // vfs_hash_name(name), set when the node is inserted
+    struct vfs_node *hash_next;          // Next child in the same bucket of the parent
+    struct vfs_node **buckets;           // nullptr until the first child is inserted
+    uint32_t bucket_count;               // Power of two, doubled once there are more children than buckets
+    uint32_t child_count;
+    bool mount_point;                    // Something is mounted here, only then does a lookup look at g_mounts
+
+    // Lifetime, see vfs_node_get
+    uint32_t refcount;                   // Handles from open() that haven't been closed yet
+    bool orphaned;                       // Removed while still open, the last close frees it
 
     // VFS Operations
     vfs_err_t (*read)(struct vfs_node *, uint32_t, uint32_t, uint8_t *);
     vfs_err_t (*write)(struct vfs_node *, uint32_t, uint32_t, const uint8_t *);
     vfs_err_t (*remove)(struct vfs_node *, struct vfs_node *);
     vfs_err_t (*create)(struct vfs_node *, const char *, vfs_node_type_t, struct vfs_node ** /* will be filled */);
+    // Optional, points at the bytes from `offset` on without copying them, see read_direct
+    vfs_err_t (*map)(struct vfs_node *, uint32_t, const uint8_t ** /* will be filled */, uint32_t * /* will be filled */);
+    // Optional scatter/gather at a 64-bit offset, both return how many bytes moved or -1.
+    // preadv/pwritev fall back to read/write once per segment where these are missing.
+    int64_t (*readv)(struct vfs_node *, vfs_off_t, const struct vfs_iovec *, uint32_t);
+    int64_t (*writev)(struct vfs_node *, vfs_off_t, const struct vfs_iovec *, uint32_t);
+    // Optional page granular backing store. Reads and writes of a node with readpage go through the page cache,
+    // readpage fills a whole page (zeros past the end of the file), writepage stores the first `length` bytes of one.
+    vfs_err_t (*readpage)(struct vfs_node *, uint32_t, uint8_t *);
+    vfs_err_t (*writepage)(struct vfs_node *, uint32_t, const uint8_t *, uint32_t);
+    // Optional, frees whatever the filesystem keeps for the node right before the node itself goes
+    void (*release)(struct vfs_node *);
 };
 
 struct vfs_mount {
@@ -47,28 +86,53 @@ struct vfs_tree {
     struct vfs_node *root;               // Root directory node
 };
 
+#define VFS_INITIAL_BUCKETS 8
+#define VFS_NAME_MAX 256
+
 struct vfs_tree *vfs_initialize(); 
+uint32_t vfs_hash_name(const char *name);
 
 // Do NOT call these as they ignore permissions
 struct vfs_node *vfs_create_node(const char *name, vfs_node_type_t type, struct vfs_node *parent);
 void vfs_insert_node(struct vfs_node *parent, struct vfs_node *node);
 
+// Takes the node and everything below it out of the tree, nodes somebody still has open are freed by their last close
 void vfs_remove_node(struct vfs_node *parent, struct vfs_node *node);
+// Takes the node out of its parent without freeing anything
+void vfs_unlink_node(struct vfs_node *parent, struct vfs_node *node);
 struct vfs_node *vfs_search_node(struct vfs_node *parent, const char *name);
 int vfs_read(struct vfs_node *file, uint32_t offset, uint32_t size, uint8_t *buffer);
 int vfs_write(struct vfs_node *file, uint32_t offset, uint32_t size, const uint8_t *buffer);
+// Doesn't allocate and may run on several CPUs at once, repeated lookups of a path are served from the dentry cache
 struct vfs_node *vfs_traverse_path(struct vfs_tree *vfs, const char *path);
 
 // Helpers to unify VFS node creation and manipulation
 typedef struct vfs_node* HANDLE;
 
+// A held reference keeps the node's memory valid after it is removed, reads and writes keep working on it
+HANDLE vfs_node_get(HANDLE handle);
+void vfs_node_put(HANDLE handle);
+
 vfs_err_t remove_p(const char* path);
 vfs_err_t remove(HANDLE handle);
 vfs_err_t create(const char* path, vfs_node_type_t type);
+// Every handle open() returns holds a reference and has to be given back with close()
 HANDLE open(const char* path);
 vfs_err_t close(HANDLE handle);
+// Writes back every dirty page and buffer the caches hold, VFS_ERROR if one of them couldn't be stored
+vfs_err_t sync();
 vfs_err_t read(HANDLE handle, uint32_t offset, uint32_t size, uint8_t* buffer);
 vfs_err_t write(HANDLE handle, uint32_t offset, uint32_t size, const uint8_t* buffer);
+// Positional I/O, the segments are filled or written back to back from `offset` on. Reads stop short at the end
+// of the file and return 0 past it, writes move everything or fail. Both return the bytes moved or -1.
+int64_t preadv(HANDLE handle, const struct vfs_iovec* iov, uint32_t count, vfs_off_t offset);
+int64_t pwritev(HANDLE handle, const struct vfs_iovec* iov, uint32_t count, vfs_off_t offset);
+int64_t pread(HANDLE handle, void* buffer, size_t size, vfs_off_t offset);
+int64_t pwrite(HANDLE handle, const void* buffer, size_t size, vfs_off_t offset);
+// Sets `data` to the file contents at `offset` and `length` to how many bytes are contiguous there, up to the end
+// of the file. The pointer stays valid until the next write to or removal of the file. Filesystems that can't
+// hand out their storage return VFS_NOT_PERMITTED, read is the fallback.
+vfs_err_t read_direct(HANDLE handle, uint32_t offset, const uint8_t** data, uint32_t* length);
 
 extern struct vfs_tree *g_Vfs;
 extern struct vfs_mount *g_mounts;
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <proc/spinlock.h>
+#include <proc/sched.h>
+
+#define WORKQUEUE_MAX_WORKERS 4
+
+struct work {
+    struct work *next;
+    void (*func)(struct work *);        // runs in a worker task, recover the owner with a container cast
+    uint32_t seq;                       // queue sequence number, used by flush_workqueue
+    volatile bool pending;              // queued and not yet started, a pending work can't be queued twice
+};
+
+struct worker {
+    struct workqueue *queue;
+    struct task *task;
+    bool busy;
+    uint32_t running_seq;               // seq of the work currently running when busy
+};
+
+struct workqueue {
+    spinlock_t lock;
+    struct work *head, *tail;
+    uint32_t queued_seq;                // seq handed to the next queued work
+    uint32_t dequeued_seq;              // seq of the next work a worker will pick up
+
+    struct wait_queue idle;             // workers with nothing to do
+    struct wait_queue flushers;
+
+    struct worker workers[WORKQUEUE_MAX_WORKERS];
+    uint32_t worker_count;
+};
+
+// Bottom halves of the keyboard and ATA interrupts run here, so nothing queued on it may wait for disk I/O.
+// Its workers are FIFO tasks and get the CPU ahead of the tasks waiting on them.
+extern struct workqueue *system_wq;
+
+static inline void work_init(struct work *work, void (*func)(struct work *)) {
+    work->next = nullptr;
+    work->func = func;
+    work->seq = 0;
+    work->pending = false;
+}
+
+// Workers are SCHED_FIFO at `rt_priority`, 0 leaves them on the default policy
+struct workqueue *workqueue_create(uint32_t workers, uint32_t rt_priority);
+void workqueue_init();
+
+// Safe from IRQ context, returns false if the work was already pending
+bool queue_work(struct workqueue *queue, struct work *work);
+// Blocks until every work queued before the call has finished running
+void flush_workqueue(struct workqueue *queue);
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
 #include <kheap.h>
 #include <kprintf>
 
@@ -16,6 +18,9 @@ struct rb_tree {
     struct rb_node *root;
 };
 
+// Structure embedding the node, for trees whose nodes live inside other objects
+#define rb_entry(node, type, member) ((type *)((char *)(node) - offsetof(type, member)))
+
 struct rb_node *rb_new_node(uintptr_t key);
 void rb_rotate_left(struct rb_tree *tree, struct rb_node *x);
 void rb_rotate_right(struct rb_tree *tree, struct rb_node *y);
@@ -27,5 +32,12 @@ struct rb_node *rb_search(struct rb_tree *tree, uintptr_t key);
 struct rb_tree *create_tree();
 
 void rb_delete(struct rb_tree *tree, uintptr_t key);
-void rb_delete_fixup(struct rb_tree *tree, struct rb_node *x);
 struct rb_node *rb_minimum(struct rb_node *node);
+
+// Intrusive interface, nothing is allocated and `key` is unused, the caller orders nodes with `less`.
+// Equal nodes go right of each other so insertion order is kept among them.
+void rb_link(struct rb_tree *tree, struct rb_node *node, bool (*less)(const struct rb_node *a, const struct rb_node *b));
+void rb_erase(struct rb_tree *tree, struct rb_node *node);
+struct rb_node *rb_first(struct rb_tree *tree);
+struct rb_node *rb_last(struct rb_tree *tree);
+struct rb_node *rb_next(struct rb_node *node);
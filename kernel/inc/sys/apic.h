@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define LAPIC_VIRT_BASE         0xFEE00000    // Inside VMM_MMIO_BASE's window
+
+#define LAPIC_REG_ID            0x020
+#define LAPIC_REG_VERSION       0x030
+#define LAPIC_REG_TPR           0x080
+#define LAPIC_REG_EOI           0x0B0
+#define LAPIC_REG_LDR           0x0D0
+#define LAPIC_REG_DFR           0x0E0
+#define LAPIC_REG_SVR           0x0F0
+#define LAPIC_REG_ESR           0x280
+#define LAPIC_REG_ICR_LOW       0x300
+#define LAPIC_REG_ICR_HIGH      0x310
+#define LAPIC_REG_LVT_TIMER     0x320
+#define LAPIC_REG_LVT_LINT0     0x350
+#define LAPIC_REG_LVT_LINT1     0x360
+#define LAPIC_REG_LVT_ERROR     0x370
+#define LAPIC_REG_TIMER_INITIAL 0x380
+#define LAPIC_REG_TIMER_CURRENT 0x390
+#define LAPIC_REG_TIMER_DIVIDE  0x3E0
+
+#define LAPIC_SVR_ENABLE        0x100
+#define LAPIC_LVT_MASKED        0x10000
+#define LAPIC_TIMER_PERIODIC    0x20000
+#define LAPIC_TIMER_DIVIDE_16   0x3
+
+#define LAPIC_ICR_FIXED         0x000
+#define LAPIC_ICR_INIT          0x500
+#define LAPIC_ICR_STARTUP       0x600
+#define LAPIC_ICR_PENDING       0x1000
+#define LAPIC_ICR_ASSERT        0x4000
+#define LAPIC_ICR_LEVEL         0x8000
+#define LAPIC_ICR_ALL_BUT_SELF  0xC0000
+
+#define LAPIC_TIMER_VECTOR      0xEF
+#define LAPIC_SPURIOUS_VECTOR   0xFF
+
+extern volatile uint32_t* lapic;
+// Timer ticks per second with LAPIC_TIMER_DIVIDE_16, 0 until calibrated
+extern uint32_t lapic_timer_frequency;
+
+static inline uint32_t lapic_read(uint32_t reg) {
+    return lapic[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value) {
+    lapic[reg / 4] = value;
+}
+
+static inline uint8_t lapic_id() {
+    return lapic_read(LAPIC_REG_ID) >> 24;
+}
+
+static inline void lapic_eoi() {
+    lapic_write(LAPIC_REG_EOI, 0);
+}
+
+bool lapic_supported();
+void lapic_map(uint32_t physical_address);
+void lapic_init();
+// Measures the timer against PIT channel 2, the bus clock is the same on every CPU so the boot CPU does it once
+bool lapic_timer_calibrate();
+// Starts this CPU's timer firing `vector` `hz` times a second
+void lapic_timer_start(uint8_t vector, uint32_t hz);
+void lapic_send_ipi(uint8_t apic_id, uint32_t command);
+void lapic_broadcast_ipi(uint8_t vector);
@@ -51,9 +51,17 @@ typedef struct {
     uint16_t iomap_base; // I/O map base address
 } __attribute__((packed)) tss_t;
 
+#define GDT_KERNEL_CODE_SELECTOR 0x08
+#define GDT_KERNEL_DATA_SELECTOR 0x10
+#define GDT_USER_CODE_SELECTOR   0x1B
+#define GDT_USER_DATA_SELECTOR   0x23
+#define GDT_TSS_SELECTOR         0x28
+
+// Boot CPU tables, application processors get their own through gdt_setup
 extern gdt_t gdt;
 extern gdt_pointer_t gdt_ptr;
 extern tss_t tss;
 
 void gdt_init();
-void gdt_load();
+void gdt_setup(gdt_t* table, gdt_pointer_t* pointer, tss_t* task_state, uint32_t esp0);
+void gdt_load(gdt_pointer_t* pointer);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 
 typedef enum
 {
@@ -18,7 +19,11 @@ typedef enum
     IDT_FLAG_PRESENT                = 0x80,
 } IDT_FLAGS;
 
+// ISA IRQs land on PIC_REMAP_OFFSET + irq through either the PIC or the IO APIC
+#define PIC_REMAP_OFFSET        0x20
+
 void idt_init();
+void idt_load();
 void idt_disable_gate(int interrupt);
 void idt_enable_gate(int interrupt);
 void idt_set_gate(int interrupt, void* base, uint16_t segmentDescriptor, uint8_t flags);
@@ -34,7 +39,28 @@ typedef struct
 typedef void (*ISRHandler)(registers_t* regs);
 typedef void (*IRQHandler)(registers_t* regs);
 void idt_register_handler(int interrupt, ISRHandler handler);
+// Kills the task when the exception came from ring 3 and panics otherwise, for handlers that can't resolve their exception
+[[noreturn]] void idt_unhandled_exception(registers_t* regs);
 void irq_register_handler(int irq, IRQHandler handler);
+// Go to the IO APIC once it is active and to the PIC otherwise, handlers registered with irq_register_handler get their EOI from irq_default_handler
+void irq_eoi(int irq);
+void irq_mask(int irq);
+void irq_unmask(int irq);
+// Makes the current interrupt return into `frame` instead of the interrupted context (task switch)
+void idt_switch_frame(registers_t* frame);
+// Clears `flag` once the CPU has switched away from the interrupted stack, so it is safe to run or free elsewhere
+void idt_release_on_exit(volatile bool* flag);
+
+typedef struct
+{
+    uint64_t count;
+    uint64_t cycles;            // TSC cycles spent dispatching, handler included. Syscalls aren't timed.
+    uint64_t max_cycles;
+    uint64_t spurious;          // How many of them were IRQ7/15 the PIC raised with nothing in service
+} irq_stat_t;
+
+// Sums the counters every CPU keeps for `vector`
+void idt_get_stats(int vector, irq_stat_t* out);
 
 typedef struct
 {
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define IOAPIC_VIRT_BASE        0xFEC00000    // VMM_MMIO_BASE, one page per IO APIC
+
+#define IOAPIC_REG_SELECT       0x00
+#define IOAPIC_REG_WINDOW       0x10
+
+#define IOAPIC_ID               0x00
+#define IOAPIC_VERSION          0x01
+#define IOAPIC_REDIRECTION      0x10
+
+#define IOAPIC_REDIR_ACTIVE_LOW 0x2000
+#define IOAPIC_REDIR_LEVEL      0x8000
+#define IOAPIC_REDIR_MASKED     0x10000
+
+// Set once the IO APICs took over from the 8259, EOIs then go to the local APIC
+extern bool ioapic_active;
+
+// Routes the ISA IRQs described by the MP tables to `vector_base + irq` on the CPU with `apic_id` and masks the PIC
+bool ioapic_init(uint8_t apic_id, uint8_t vector_base);
+void ioapic_mask(int irq);
+void ioapic_unmask(int irq);
@@ -9,10 +9,16 @@ extern uint8_t* bitmap;
 extern size_t total_pages;
 extern size_t bitmap_size;
 
+// Caches that can give frames back register one of these, an allocation that finds no free frame calls them
+// and tries again. They run wherever pmm_alloc was called, so they must neither block nor allocate.
+typedef size_t (*pmm_shrinker_t)(size_t wanted);
+#define PMM_MAX_SHRINKERS 4
+
 void pmm_init(struct ultra_boot_context* ctx);
 void* pmm_alloc();
 void* pmm_alloc_pages(size_t num_pages);
 void pmm_free(void* ptr);
 void pmm_free_pages(void* address, size_t num_pages);   
 void pmm_reclaim_bootloader_memory();
+void pmm_register_shrinker(pmm_shrinker_t shrinker);
 
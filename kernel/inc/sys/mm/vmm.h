@@ -3,9 +3,16 @@
 #define PAGE_PRESENT 0x1
 #define PAGE_RW 0x2
 #define PAGE_USER 0x4
+#define PAGE_WRITETHROUGH 0x8
+#define PAGE_CACHE_DISABLE 0x10
 #define PAGE_SIZE 4096
 
 #define PAGE_MASK (~(PAGE_SIZE - 1))
+
+// Local APIC and IO APIC registers are mapped from here up, the direct map of physical memory stops below.
+// Physical memory past VMM_DIRECT_MAP_END has no higher half address and is never handed out.
+#define VMM_MMIO_BASE 0xFEC00000
+#define VMM_DIRECT_MAP_END (VMM_MMIO_BASE - higher_half_base < 0x40000000 ? VMM_MMIO_BASE - higher_half_base : 0x40000000)
 #define ROUND_DOWN_TO_PAGE(addr) ((addr) & PAGE_MASK)
 #define ROUND_UP_TO_PAGE(addr)   (((addr) + PAGE_SIZE - 1) & PAGE_MASK)
 
@@ -59,6 +66,13 @@ extern uintptr_t higher_half_base;
 
 bool vmm_map_page(vmm_context_t* pageDirectory, uint32_t virtualAddress, size_t size, uint32_t physicalAddress, uint32_t flags);
 bool vmm_unmap_page(vmm_context_t* pageDirectory, uint32_t virtualAddress);
+// Physical address `virtualAddress` is mapped to, 0 if it isn't
+uintptr_t vmm_virt_to_phys(vmm_context_t* pageDirectory, uint32_t virtualAddress);
+// PAGE_PRESENT, PAGE_RW and PAGE_USER as they apply to `virtualAddress`, both levels taken into account, 0 if unmapped
+uint32_t vmm_page_flags(vmm_context_t* pageDirectory, uint32_t virtualAddress);
 
 void vmm_init_pd(vmm_context_t* pageDirectory);
-void vmm_switch_pd(vmm_context_t* pageDirectory);
\ No newline at end of file
+void vmm_switch_pd(vmm_context_t* pageDirectory);
+// Fresh address space with an empty user half and the kernel half shared with kernel_page_directory
+bool vmm_create_pd(vmm_context_t* pageDirectory);
+void vmm_destroy_pd(vmm_context_t* pageDirectory);
\ No newline at end of file
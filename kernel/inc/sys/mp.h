@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MP_MAX_CPUS     8
+#define MP_MAX_IOAPICS  4
+#define MP_ISA_IRQS     16
+
+#define MP_ENTRY_PROCESSOR      0
+#define MP_ENTRY_BUS            1
+#define MP_ENTRY_IOAPIC         2
+#define MP_ENTRY_IO_INTERRUPT   3
+#define MP_ENTRY_LOCAL_INTERRUPT 4
+
+#define MP_CPU_ENABLED  0x1
+#define MP_CPU_BSP      0x2
+
+typedef struct {
+    char signature[4];          // "_MP_"
+    uint32_t config_table;      // Physical address of the configuration table, 0 for a default configuration
+    uint8_t length;             // In 16 byte units
+    uint8_t revision;
+    uint8_t checksum;
+    uint8_t features[5];
+} __attribute__((packed)) mp_floating_pointer_t;
+
+typedef struct {
+    char signature[4];          // "PCMP"
+    uint16_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[8];
+    char product_id[12];
+    uint32_t oem_table;
+    uint16_t oem_table_size;
+    uint16_t entry_count;
+    uint32_t lapic_address;
+    uint16_t extended_length;
+    uint8_t extended_checksum;
+    uint8_t reserved;
+} __attribute__((packed)) mp_config_table_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t lapic_id;
+    uint8_t lapic_version;
+    uint8_t flags;
+    uint32_t signature;
+    uint32_t features;
+    uint32_t reserved[2];
+} __attribute__((packed)) mp_processor_entry_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t bus_id;
+    char bus_type[6];
+} __attribute__((packed)) mp_bus_entry_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t id;
+    uint8_t version;
+    uint8_t flags;
+    uint32_t address;
+} __attribute__((packed)) mp_ioapic_entry_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t interrupt_type;
+    uint16_t flags;             // Polarity in bits 0-1, trigger mode in bits 2-3
+    uint8_t source_bus;
+    uint8_t source_irq;
+    uint8_t ioapic_id;
+    uint8_t ioapic_pin;
+} __attribute__((packed)) mp_interrupt_entry_t;
+
+struct mp_isa_irq {
+    bool present;
+    uint8_t ioapic_id;
+    uint8_t pin;
+    uint16_t flags;
+};
+
+struct mp_info {
+    bool found;
+    uint32_t lapic_address;
+
+    uint32_t cpu_count;
+    uint8_t cpu_apic_ids[MP_MAX_CPUS];
+    uint8_t bsp_apic_id;
+
+    uint32_t ioapic_count;
+    struct {
+        uint8_t id;
+        uint32_t address;
+    } ioapics[MP_MAX_IOAPICS];
+
+    struct mp_isa_irq isa_irqs[MP_ISA_IRQS];
+};
+
+extern struct mp_info mp_info;
+
+// Must run while the bootloader's mapping of the low megabyte is still active
+bool mp_parse();
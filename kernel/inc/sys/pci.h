@@ -56,6 +56,7 @@ typedef uint32_t pci_dev_t;
 #define PCI_HEADER_TYPE_CARDBUS 2
 #define PCI_TYPE_BRIDGE 0x0604
 #define PCI_TYPE_SATA   0x0106
+#define PCI_TYPE_IDE    0x0101
 #define PCI_NONE 0xFFFF
 
 #define MAX_DEVICE_PER_BUS       32
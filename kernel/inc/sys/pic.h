@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #define PIC1_COMMAND_PORT           0x20
 #define PIC1_DATA_PORT              0x21
@@ -14,3 +15,4 @@ void pic_mask(int irq);
 void pic_unmask(int irq);
 uint16_t pic_read_irqrr();
 uint16_t pic_read_isr();
+bool pic_is_spurious(int irq);
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/gdt.h>
+#include <sys/idt.h>
+#include <sys/apic.h>
+#include <sys/mp.h>
+#include <proc/spinlock.h>
+#include <proc/sched_class.h>
+
+#define MAX_CPUS MP_MAX_CPUS
+
+// Broadcast by the boot CPU on every timer tick so the others preempt too
+#define SCHED_IPI_VECTOR 0xF0
+
+struct task;
+
+struct cpu {
+    uint32_t id;                        // Index into cpus[]
+    uint8_t apic_id;
+    volatile bool online;
+
+    gdt_t* gdt;
+    gdt_pointer_t* gdt_ptr;
+    tss_t* tss;
+
+    registers_t* switch_frame;          // Set by idt_switch_frame, consumed when the handler returns
+    volatile bool* release_on_exit;     // Cleared once this CPU has left the interrupted stack
+
+    struct run_queue rq;
+    struct task* current;
+    struct task* idle;
+};
+
+extern struct cpu cpus[MAX_CPUS];
+extern uint32_t cpu_count;
+extern volatile bool smp_active;
+extern uint8_t apic_to_cpu[256];
+
+static inline struct cpu* this_cpu() {
+    if (!smp_active) return &cpus[0];
+    return &cpus[apic_to_cpu[lapic_id()]];
+}
+
+// Fills in the boot CPU, maps the local APIC and starts every other processor from the MP tables
+void smp_init();
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/idt.h>
+
+// int 0x80 works on every CPU, sysenter only where cpuid reports SEP. Both take the number in eax
+// and the arguments in ebx, esi and edi and return in eax. sysenter additionally expects the
+// return address in edx and the user stack pointer in ecx, so both of them are clobbered.
+#define SYSCALL_VECTOR 0x80
+#define SYSCALL_MAX_PATH 256
+// Most bytes one read or write moves through the kernel, larger requests come back short
+#define SYSCALL_IO_MAX 0x10000
+
+enum syscall_number {
+    SYS_EXIT,                           // (code)
+    SYS_YIELD,                          // ()
+    SYS_SLEEP,                          // (ms)
+    SYS_OPEN,                           // (path, VFS_O_* flags) -> fd
+    SYS_CLOSE,                          // (fd)
+    SYS_READ,                           // (fd, buffer, size) -> bytes read
+    SYS_WRITE,                          // (fd, buffer, size) -> bytes written
+    SYS_SEEK,                           // (fd, offset, VFS_SEEK_*) -> new offset
+    SYS_DUP,                            // (fd) -> new fd sharing the offset
+    SYS_READV,                          // (fd, iovec array, count) -> bytes read
+    SYS_WRITEV,                         // (fd, iovec array, count) -> bytes written
+    SYS_DUP2,                           // (fd, target) -> target, closing what target held before
+    SYS_SYNC,                           // () -> 0, -1 if some cached data couldn't be written back
+    SYSCALL_COUNT
+};
+
+struct cpu;
+
+extern bool sysenter_supported;
+
+// Installs the int 0x80 gate and sets up sysenter on the boot CPU
+void syscall_init();
+// Points this CPU's sysenter MSRs at the entry stub, application processors call it themselves
+void syscall_init_cpu(struct cpu* cpu);
@@ -8,20 +8,29 @@
 #include <sys/idt.h>
 #include <sys/pic.h>
 #include <sys/pci.h>
+#include <sys/mp.h>
+#include <sys/smp.h>
+#include <sys/ioapic.h>
+#include <sys/syscall.h>
 #include <sys/mm/pmm.h>
 #include <sys/mm/vmm.h>
 #include <kheap.h>
 #include <ultra_protocol.h>
 #include <proc/task.h>
 #include <proc/sched.h>
+#include <proc/workqueue.h>
+#include <proc/elf.h>
+#include <proc/pagecache.h>
 
 #include <rbtree.h>
 #include <proc/vfs.h>
 #include <proc/ramfs.h>
+#include <proc/initramfs.h>
 
 #include <fs/ata.h>
 #include <fs/mbr.h>
 #include <fs/fat32.h>
+#include <fs/blkdev.h>
 
 #include <fshell/framebuffer.h>
 #include <fshell/init.h>
@@ -37,6 +46,14 @@ struct vfs_tree *g_Vfs = NULL;
 
 void main() {
     g_Vfs = vfs_initialize();
+    initramfs_unpack(g_Vfs->root);
+
+    // the disk as a whole, read and written through the page cache
+    if (ata_sectors) {
+        struct vfs_node *dev = vfs_search_node(g_Vfs->root, "dev");
+        if (!dev) dev = vfs_create_node("dev", VFS_RAMFS_FOLDER, g_Vfs->root);
+        if (dev && dev->type == VFS_RAMFS_FOLDER) blkdev_create(dev, "ata0", &ata_disk, ata_sectors);
+    }
 
     fshell_callback();
     for(;;) { yield(); }
@@ -69,6 +86,15 @@ void main() {
                 memory_map = kmalloc(head->size);
                 memcpy(memory_map, head, head->size);
                 break;
+            case ULTRA_ATTRIBUTE_MODULE_INFO: {
+                // module memory stays reserved and is part of the higher half map vmm_init_pd builds
+                struct ultra_module_info_attribute* module = (struct ultra_module_info_attribute*)head;
+                if (strcmp(module->name, INITRAMFS_MODULE_NAME) == 0) {
+                    uintptr_t address = module->address < higher_half_base ? module->address + higher_half_base : module->address;
+                    initramfs_set_module((const void*)address, module->size);
+                }
+                break;
+            }
             case ULTRA_ATTRIBUTE_FRAMEBUFFER_INFO:
                 framebuffer = kmalloc(head->size);
                 memcpy(framebuffer, head, head->size);
@@ -79,6 +105,8 @@ void main() {
     }
     pmm_memory_map = memory_map;
 
+    // the MP tables live in BIOS memory that only the bootloader's mapping covers
+    mp_parse();
     vmm_init_pd(&kernel_page_directory);
 
     size_t framebuffer_size = framebuffer->fb.width * framebuffer->fb.height * 4;
@@ -89,10 +117,18 @@ void main() {
     set_background_color(0x12345432);
     
     pmm_reclaim_bootloader_memory();
+    smp_init();
+    syscall_init();
+    elf_init();
+    pagecache_init();
+    ioapic_init(this_cpu()->apic_id, PIC_REMAP_OFFSET);
+    ata_init();
     init_fshell();
 
-    struct task callback_task = task_create((uintptr_t)main, 0, 0, 10000, kernel_page_directory);
-    sched_init(&callback_task);
+    workqueue_init();
+
+    struct task *callback_task = task_create((uintptr_t)main, 0, 10000, kernel_page_directory);
+    sched_init(callback_task);
 
-    for(;;) ;
+    for(;;) hlt();
 }
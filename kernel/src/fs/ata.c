@@ -4,65 +4,440 @@
 #include <kheap.h>
 #include <sys/idt.h>
 #include <proc/sched.h>
+#include <proc/workqueue.h>
 #include <sys/pic.h>
+#include <sys/pci.h>
+#include <sys/mm/pmm.h>
+#include <sys/mm/vmm.h>
 
-static void ATA_wait_BSY()
+#define ATA_CMD_READ_PIO 0x20
+#define ATA_CMD_WRITE_PIO 0x30
+#define ATA_CMD_READ_MULTIPLE 0xC4
+#define ATA_CMD_WRITE_MULTIPLE 0xC5
+#define ATA_CMD_SET_MULTIPLE 0xC6
+#define ATA_CMD_IDENTIFY 0xEC
+#define ATA_CMD_READ_DMA 0xC8
+#define ATA_CMD_WRITE_DMA 0xCA
+#define ATA_CMD_CACHE_FLUSH 0xE7
+
+// IDENTIFY words, the low byte of ATA_ID_MAX_MULTIPLE is the largest DRQ block the drive takes
+#define ATA_ID_MAX_MULTIPLE 47
+#define ATA_ID_LBA28_SECTORS 60		// Two words, low one first
+// Drives may only accept powers of two, and past 16 sectors the interrupts saved stop mattering
+#define ATA_MULTIPLE_LIMIT 16
+
+#define PCI_COMMAND_IO 0x1
+#define PCI_COMMAND_BUS_MASTER 0x4
+
+// Bus master IDE functions we know, QEMU emulates the PIIX3 one
+static const uint16_t ata_controllers[][2] = {
+	{ 0x8086, 0x7010 },	// PIIX3
+	{ 0x8086, 0x7111 },	// PIIX4
+	{ 0x8086, 0x1230 },	// PIIX
+};
+
+enum ata_state {
+	ATA_IDLE,
+	ATA_PIO,		// Data moves a DRQ block per IRQ 14, the cursor below says where
+	ATA_DMA,		// Transfer running, IRQ 14 ends it
+	ATA_FLUSH,		// Write done, waiting for the cache flush to finish
+};
+
+static void ata_start(struct blk_device *dev, struct blk_request *request);
+
+struct blk_device ata_disk = {
+	.name = "ata0",
+	.max_sectors = ATA_MAX_SECTORS,
+	.start = ata_start,
+};
+
+bool ata_dma = false;
+uint32_t ata_multiple = 1;
+uint32_t ata_sectors = 0;
+static bool ata_irq = false;
+static uint16_t ata_bm_base;
+static ata_prd_t *ata_prdt;
+static uint32_t ata_prdt_phys;
+
+// Guards the state and the cursor against IRQ 14, which may come in on another CPU. Only one request is ever
+// with the driver, see blk_run_queue.
+static spinlock_t ata_lock = SPINLOCK_INIT;
+static enum ata_state ata_state = ATA_IDLE;
+static struct blk_request *ata_request;
+static struct blk_bio *ata_bio;			// Where the next sector of a PIO transfer goes or comes from
+static uint32_t ata_sector;			// Within ata_bio
+static uint32_t ata_remaining;
+
+static uint8_t ata_wait_idle()
 {
-	while (inb(0x1F7) & STATUS_BSY)
+	uint8_t status;
+	while ((status = inb(ATA_MASTER_BASE + ATA_REG_STATUS)) & STATUS_BSY)
 	;
+	return status;
 }
-static void ATA_wait_DRQ()
+
+static bool ata_status_ok(uint8_t status)
 {
-	while (!(inb(0x1F7) & STATUS_RDY))
-	;
+	return !(status & (STATUS_ERR | STATUS_DF));
+}
+
+// Waits for the drive to want the next sector, false if it reported an error instead
+static bool ata_wait_drq()
+{
+	uint8_t status = ata_wait_idle();
+	return ata_status_ok(status) && (status & STATUS_DRQ);
+}
+
+static void ata_issue(struct blk_request *request, uint8_t command)
+{
+	outb(ATA_MASTER_BASE + ATA_REG_HDDEVSEL, ATA_MASTER | ((request->lba >> 24) & 0xF));
+	outb(ATA_MASTER_BASE + ATA_REG_SECCOUNT0, (uint8_t)request->count);	// 256 wraps to 0, which is what it means
+	outb(ATA_MASTER_BASE + ATA_REG_LBA0, (uint8_t)request->lba);
+	outb(ATA_MASTER_BASE + ATA_REG_LBA1, (uint8_t)(request->lba >> 8));
+	outb(ATA_MASTER_BASE + ATA_REG_LBA2, (uint8_t)(request->lba >> 16));
+	outb(ATA_MASTER_BASE + ATA_REG_COMMAND, command);
+}
+
+// The sectors of a request are spread over its bios' buffers in order
+static void ata_cursor_reset(struct blk_request *request)
+{
+	ata_bio = request->bios;
+	ata_sector = 0;
+	ata_remaining = request->count;
+}
+
+static uint8_t ata_pio_command(enum blk_op op)
+{
+	if (ata_multiple > 1)
+		return op == BLK_READ ? ATA_CMD_READ_MULTIPLE : ATA_CMD_WRITE_MULTIPLE;
+	return op == BLK_READ ? ATA_CMD_READ_PIO : ATA_CMD_WRITE_PIO;
+}
+
+// Moves the DRQ block under the cursor through the data port and advances. The block is ata_multiple
+// sectors, or what is left of the command, and may span several bios.
+static void ata_pio_block(enum blk_op op)
+{
+	uint32_t block = ata_remaining < ata_multiple ? ata_remaining : ata_multiple;
+	ata_remaining -= block;
+	while (block > 0) {
+		uint32_t run = ata_bio->count - ata_sector;
+		if (run > block)
+			run = block;
+
+		uint8_t *data = ata_bio->buffer + ata_sector * BLK_SECTOR_SIZE;
+		if (op == BLK_READ)
+			insw(ATA_MASTER_BASE + ATA_REG_DATA, data, run * BLK_SECTOR_SIZE / 2);
+		else
+			outsw(ATA_MASTER_BASE + ATA_REG_DATA, data, run * BLK_SECTOR_SIZE / 2);
+
+		block -= run;
+		ata_sector += run;
+		if (ata_sector == ata_bio->count) {
+			ata_bio = ata_bio->next;
+			ata_sector = 0;
+		}
+	}
+}
+
+// Polled, for when IRQ 14 isn't hooked up yet. Done by the time this returns.
+static bool ata_pio_polled(struct blk_request *request)
+{
+	ata_wait_idle();
+	outb(ATA_PRIMARY_CONTROL, ATA_CONTROL_NIEN);
+	ata_cursor_reset(request);
+	ata_issue(request, ata_pio_command(request->op));
+
+	while (ata_remaining > 0) {
+		if (!ata_wait_drq())
+			return false;
+		ata_pio_block(request->op);
+	}
+
+	if (request->op == BLK_WRITE) {
+		// the drive may still hold the data in its write cache
+		ata_wait_idle();
+		outb(ATA_MASTER_BASE + ATA_REG_COMMAND, ATA_CMD_CACHE_FLUSH);
+	}
+	return ata_status_ok(ata_wait_idle());
+}
+
+// Issues the command and returns, ata_interrupt_handler moves the sectors as the drive asks for them
+static bool ata_pio_start(struct blk_request *request)
+{
+	uint32_t flags = spin_lock_irqsave(&ata_lock);
+	ata_request = request;
+	ata_state = ATA_PIO;
+	ata_cursor_reset(request);
+
+	ata_wait_idle();
+	outb(ATA_PRIMARY_CONTROL, 0);
+	ata_issue(request, ata_pio_command(request->op));
+
+	// a write's first block is asked for without an interrupt, every later one and the end of the command raise one
+	bool ok = true;
+	if (request->op == BLK_WRITE) {
+		ok = ata_wait_drq();
+		if (ok)
+			ata_pio_block(BLK_WRITE);
+		else
+			ata_state = ATA_IDLE;
+	}
+	spin_unlock_irqrestore(&ata_lock, flags);
+	return ok;
+}
+
+// Describes the bios' buffers in the PRD table, false if one of them can't be reached by the controller
+static bool ata_build_prdt(struct blk_request *request)
+{
+	uint32_t entries = 0;
+	for (struct blk_bio *bio = request->bios; bio; bio = bio->next) {
+		uintptr_t address = (uintptr_t)bio->buffer;
+		uint32_t left = bio->count * BLK_SECTOR_SIZE;
+		if (address & 1)
+			return false;
+
+		// split at every page, physically the next page can be anywhere and no piece crosses 64 KiB
+		while (left > 0) {
+			uint32_t chunk = PAGE_SIZE - (address & ~PAGE_MASK);
+			if (chunk > left)
+				chunk = left;
+			uintptr_t phys = vmm_virt_to_phys(&kernel_page_directory, address);
+			if (!phys || entries == ATA_PRD_MAX)
+				return false;
+
+			ata_prdt[entries++] = (ata_prd_t){ .address = phys, .size = (uint16_t)chunk, .flags = 0 };
+			address += chunk;
+			left -= chunk;
+		}
+	}
+	if (entries == 0)
+		return false;
+	ata_prdt[entries - 1].flags = ATA_PRD_END;
+	return true;
 }
 
+// Starts the transfer and returns, IRQ 14 completes it
+static bool ata_dma_start(struct blk_request *request)
+{
+	if (!ata_build_prdt(request))
+		return false;
+
+	uint32_t flags = spin_lock_irqsave(&ata_lock);
+	uint8_t direction = request->op == BLK_READ ? ATA_BM_CMD_READ : 0;
+	outb(ata_bm_base + ATA_BM_COMMAND, 0);
+	outl(ata_bm_base + ATA_BM_PRDT, ata_prdt_phys);
+	// both bits are write one to clear
+	outb(ata_bm_base + ATA_BM_STATUS, inb(ata_bm_base + ATA_BM_STATUS) | ATA_BM_STATUS_IRQ | ATA_BM_STATUS_ERROR);
+	outb(ata_bm_base + ATA_BM_COMMAND, direction);
 
-void ata_read_sectors_pio(uint8_t *target_address, uint32_t LBA, uint8_t sector_count) {
-	ATA_wait_BSY();
-	outb(ATA_MASTER_BASE + ATA_REG_HDDEVSEL, ATA_MASTER | ((LBA >> 24) & 0xF));
-	outb(ATA_MASTER_BASE + ATA_REG_SECCOUNT0, sector_count);
-	outb(ATA_MASTER_BASE + ATA_REG_LBA0, (uint8_t)LBA);
-	outb(ATA_MASTER_BASE + ATA_REG_LBA1, (uint8_t)(LBA >> 8));
-	outb(ATA_MASTER_BASE + ATA_REG_LBA2, (uint8_t)(LBA >> 16));
-	outb(ATA_MASTER_BASE + ATA_REG_COMMAND, 0x20);
+	ata_request = request;
+	ata_state = ATA_DMA;
 
-	uint16_t *target = (uint16_t *)target_address;
+	ata_wait_idle();
+	outb(ATA_PRIMARY_CONTROL, 0);
+	ata_issue(request, request->op == BLK_READ ? ATA_CMD_READ_DMA : ATA_CMD_WRITE_DMA);
+	outb(ata_bm_base + ATA_BM_COMMAND, direction | ATA_BM_CMD_START);
+	spin_unlock_irqrestore(&ata_lock, flags);
+	return true;
+}
 
-	for (int j = 0; j < sector_count; j++) {
-		ATA_wait_BSY();
-		ATA_wait_DRQ();
-		for (int i = 0; i < 256; i++)
-			target[i] = inw(0x1F0);
-		target += 256;
+static void ata_start(struct blk_device *dev, struct blk_request *request)
+{
+	if (!ata_irq) {
+		blk_end_request(dev, request, ata_pio_polled(request));
+		return;
 	}
+
+	// PIO covers odd buffers and machines without a bus master controller
+	if ((ata_dma && ata_dma_start(request)) || ata_pio_start(request))
+		return;
+	blk_end_request(dev, request, false);
+}
+
+void ata_read_sectors_pio(uint8_t *target_address, uint32_t LBA, uint32_t sector_count) {
+	blk_rw(&ata_disk, BLK_READ, LBA, sector_count, target_address);
 }
 
-void ata_write_sectors_pio(uint32_t LBA, uint8_t sector_count, uint8_t *rawBytes) {
-	ATA_wait_BSY();
-	outb(0x1F6, 0xE0 | ((LBA >> 24) & 0xF));
-	outb(0x1F2, sector_count);
-	outb(0x1F3, (uint8_t)LBA);
-	outb(0x1F4, (uint8_t)(LBA >> 8));
-	outb(0x1F5, (uint8_t)(LBA >> 16));
-	outb(0x1F7, 0x30);
+void ata_write_sectors_pio(uint32_t LBA, uint32_t sector_count, uint8_t *rawBytes) {
+	blk_rw(&ata_disk, BLK_WRITE, LBA, sector_count, rawBytes);
+}
 
-	uint32_t *bytes = (uint32_t *)rawBytes;
+// With ata_lock held, returns the finished request or nullptr while the command is still going
+static struct blk_request *ata_pio_interrupt(bool *ok)
+{
+	// reading the status acknowledges the interrupt
+	uint8_t status = inb(ATA_MASTER_BASE + ATA_REG_STATUS);
+	*ok = ata_status_ok(status);
+	if (!*ok)
+		return ata_request;
 
-	for (int j = 0; j < sector_count; j++) {
-		ATA_wait_BSY();
-		ATA_wait_DRQ();
-		for (int i = 0; i < 256; i++) {
-			outl(0x1F0, bytes[i]);
+	if (ata_remaining > 0) {
+		if (!(status & STATUS_DRQ)) {
+			*ok = false;
+			return ata_request;
 		}
-		bytes += 256;
+		ata_pio_block(ata_request->op);
+		// a read is over with its last block, a write raises one more interrupt once that block is stored
+		return ata_request->op == BLK_READ && ata_remaining == 0 ? ata_request : nullptr;
+	}
+
+	ata_state = ATA_FLUSH;
+	outb(ATA_MASTER_BASE + ATA_REG_COMMAND, ATA_CMD_CACHE_FLUSH);
+	return nullptr;
+}
+
+// With ata_lock held, same as ata_pio_interrupt
+static struct blk_request *ata_dma_interrupt(bool *ok)
+{
+	uint8_t bm_status = inb(ata_bm_base + ATA_BM_STATUS);
+	if (!(bm_status & ATA_BM_STATUS_IRQ)) {
+		// not the drive, the line may be shared
+		*ok = true;
+		return nullptr;
+	}
+
+	outb(ata_bm_base + ATA_BM_COMMAND, 0);
+	uint8_t status = inb(ATA_MASTER_BASE + ATA_REG_STATUS);
+	outb(ata_bm_base + ATA_BM_STATUS, ATA_BM_STATUS_IRQ | ATA_BM_STATUS_ERROR);
+
+	*ok = ata_status_ok(status) && !(bm_status & ATA_BM_STATUS_ERROR);
+	if (*ok && ata_request->op == BLK_WRITE) {
+		// the flush raises the IRQ again once the data is on the platters
+		ata_state = ATA_FLUSH;
+		outb(ATA_MASTER_BASE + ATA_REG_COMMAND, ATA_CMD_CACHE_FLUSH);
+		return nullptr;
 	}
+	return ata_request;
+}
+
+static struct blk_request *ata_done;
+static bool ata_done_ok;
+
+static void ata_complete(struct work *)
+{
+	struct blk_request *request = ata_done;
+	ata_done = nullptr;
+	// completing may start the next request, which takes ata_lock again
+	blk_end_request(&ata_disk, request, ata_done_ok);
 }
 
+static struct work ata_complete_work = { .func = ata_complete };
+
 void ata_interrupt_handler(registers_t*)
-{}
+{
+	spin_lock(&ata_lock);
+	struct blk_request *done = nullptr;
+	bool ok = true;
+	switch (ata_state) {
+	case ATA_IDLE:
+		inb(ATA_MASTER_BASE + ATA_REG_STATUS);
+		break;
+	case ATA_PIO:
+		done = ata_pio_interrupt(&ok);
+		break;
+	case ATA_DMA:
+		done = ata_dma_interrupt(&ok);
+		break;
+	case ATA_FLUSH:
+		ok = ata_status_ok(inb(ATA_MASTER_BASE + ATA_REG_STATUS));
+		done = ata_request;
+		break;
+	}
+
+	if (done) {
+		ata_state = ATA_IDLE;
+		ata_request = nullptr;
+	}
+	spin_unlock(&ata_lock);
+
+	if (!done)
+		return;
+	// the bios' end callbacks and starting the next request run on system_wq, only one request is ever out so
+	// one slot is enough. Before workqueue_init there is nothing to defer to.
+	ata_done = done;
+	ata_done_ok = ok;
+	if (system_wq)
+		queue_work(system_wq, &ata_complete_work);
+	else
+		ata_complete(&ata_complete_work);
+}
+
+static void ata_dma_init()
+{
+	pci_dev_t dev = 0;
+	for (uint32_t i = 0; i < sizeof(ata_controllers) / sizeof(ata_controllers[0]) && !dev; i++)
+		dev = pci_get_device(ata_controllers[i][0], ata_controllers[i][1], PCI_TYPE_IDE);
+	if (!dev) {
+		kprintf("ata: no bus master IDE controller, using PIO\n");
+		return;
+	}
+
+	uint32_t bar4 = pci_read(dev, PCI_BAR4);
+	if (!(bar4 & 1)) {
+		kprintf("ata: BAR4 isn't an I/O port range, using PIO\n");
+		return;
+	}
+
+	void *frame = pmm_alloc_pages(ATA_PRD_PAGES);
+	if (!frame) {
+		kprintf("ata: no memory for the PRD table, using PIO\n");
+		return;
+	}
+
+	ata_bm_base = bar4 & ~3;
+	ata_prdt = (ata_prd_t *)((uintptr_t)frame + higher_half_base);
+	ata_prdt_phys = (uintptr_t)frame;
+	pci_write(dev, PCI_COMMAND, pci_read(dev, PCI_COMMAND) | PCI_COMMAND_IO | PCI_COMMAND_BUS_MASTER);
+	ata_dma = true;
+	kprintf("ata: bus master DMA at port 0x%x\n", ata_bm_base);
+}
+
+// Asks the drive for its size and how many sectors it moves per DRQ block, PIO switches to READ/WRITE MULTIPLE
+// with that. Polled, IRQ 14 isn't hooked up yet.
+static void ata_identify()
+{
+	// a floating bus reads as all ones, there is no drive to wait for
+	if (inb(ATA_MASTER_BASE + ATA_REG_STATUS) == 0xFF)
+		return;
+
+	ata_wait_idle();
+	outb(ATA_PRIMARY_CONTROL, ATA_CONTROL_NIEN);
+	outb(ATA_MASTER_BASE + ATA_REG_HDDEVSEL, ATA_MASTER);
+	outb(ATA_MASTER_BASE + ATA_REG_COMMAND, ATA_CMD_IDENTIFY);
+	if (inb(ATA_MASTER_BASE + ATA_REG_STATUS) == 0 || !ata_wait_drq()) {
+		kprintf("ata: no drive answered IDENTIFY\n");
+		return;
+	}
+
+	uint16_t identify[256];
+	insw(ATA_MASTER_BASE + ATA_REG_DATA, identify, 256);
+	ata_sectors = identify[ATA_ID_LBA28_SECTORS] | (uint32_t)identify[ATA_ID_LBA28_SECTORS + 1] << 16;
+	kprintf("ata: primary master has %lu sectors\n", ata_sectors);
+
+	uint32_t block = identify[ATA_ID_MAX_MULTIPLE] & 0xFF;
+	if (block > ATA_MULTIPLE_LIMIT)
+		block = ATA_MULTIPLE_LIMIT;
+	while (block & (block - 1))
+		block &= block - 1;
+	if (block < 2)
+		return;
+
+	outb(ATA_MASTER_BASE + ATA_REG_HDDEVSEL, ATA_MASTER);
+	outb(ATA_MASTER_BASE + ATA_REG_SECCOUNT0, (uint8_t)block);
+	outb(ATA_MASTER_BASE + ATA_REG_COMMAND, ATA_CMD_SET_MULTIPLE);
+	if (!ata_status_ok(ata_wait_idle())) {
+		kprintf("ata: drive refused SET MULTIPLE %u, PIO moves single sectors\n", block);
+		return;
+	}
+	ata_multiple = block;
+	kprintf("ata: PIO moves %u sectors per DRQ block\n", block);
+}
 
 void ata_init()
 {
 	irq_register_handler(14, ata_interrupt_handler);
+	ata_identify();
+	ata_dma_init();
+	irq_unmask(14);
+	ata_irq = true;
 }
\ No newline at end of file
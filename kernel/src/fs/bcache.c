@@ -0,0 +1,264 @@
+#include <fs/bcache.h>
+#include <proc/sched.h>
+#include <string.h>
+#include <kprintf>
+
+// Covers buckets, lru and the state of every buffer. I/O and copies run on pinned buffers without it.
+static spinlock_t bcache_lock = SPINLOCK_INIT;
+// Tasks waiting for a buffer's I/O to finish or for any buffer to be unpinned
+static struct wait_queue bcache_waiters;
+static struct bcache_buffer buffers[BCACHE_BUFFERS];
+static struct bcache_buffer *buckets[BCACHE_BUCKETS];
+static struct lru_list lru;
+static bool initialized;
+
+static uint32_t bcache_hash(struct blk_device *dev, uint32_t lba) {
+    return lru_hash(dev, lba, BCACHE_BUCKETS);
+}
+
+// With the lock held, every buffer starts out empty on the LRU list
+static void bcache_setup() {
+    for (uint32_t i = 0; i < BCACHE_BUFFERS; i++) {
+        lru_push(&lru, &buffers[i].lru);
+    }
+    initialized = true;
+}
+
+// With the lock held
+static struct bcache_buffer *coldest_unpinned() {
+    for (struct lru_link *link = lru.tail; link; link = link->prev) {
+        struct bcache_buffer *buffer = lru_entry(link, struct bcache_buffer, lru);
+        if (!buffer->pins) return buffer;
+    }
+    return nullptr;
+}
+
+static struct bcache_buffer *lookup(struct blk_device *dev, uint32_t lba) {
+    for (struct bcache_buffer *buffer = buckets[bcache_hash(dev, lba)]; buffer; buffer = buffer->hash_next) {
+        if (buffer->dev == dev && buffer->lba == lba) return buffer;
+    }
+    return nullptr;
+}
+
+static void unhash(struct bcache_buffer *buffer) {
+    if (!buffer->dev) return;
+    struct bcache_buffer **indirect = &buckets[bcache_hash(buffer->dev, buffer->lba)];
+    while (*indirect != buffer) indirect = &(*indirect)->hash_next;
+    *indirect = buffer->hash_next;
+    buffer->dev = nullptr;
+}
+
+static void bcache_io_end(struct blk_bio *bio, bool ok) {
+    struct bcache_buffer *buffer = bio->private;
+    uint32_t flags = spin_lock_irqsave(&bcache_lock);
+    if (bio->op == BLK_READ) buffer->valid = ok;
+    else if (!ok) buffer->dirty = true;
+    buffer->failed = !ok;
+    buffer->busy = false;
+    sched_wake_all(&bcache_waiters);
+    spin_unlock_irqrestore(&bcache_lock, flags);
+}
+
+// With the lock held, sleeps until nobody is doing I/O on the buffer
+static void wait_idle(struct bcache_buffer *buffer) {
+    while (buffer->busy) {
+        sched_sleep_on(&bcache_waiters, &bcache_lock);
+    }
+}
+
+// Returns the buffer for (dev, lba) pinned, taking over the coldest unpinned one on a miss. Dirty victims are
+// written back first. nullptr with *failed clear means every buffer is pinned, with *failed set the write back failed.
+static struct bcache_buffer *claim(struct blk_device *dev, uint32_t lba, bool *failed) {
+    *failed = false;
+    uint32_t flags = spin_lock_irqsave(&bcache_lock);
+    if (!initialized) bcache_setup();
+
+    for (;;) {
+        struct bcache_buffer *buffer = lookup(dev, lba);
+        if (buffer) {
+            buffer->pins++;
+            lru_touch(&lru, &buffer->lru);
+            spin_unlock_irqrestore(&bcache_lock, flags);
+            return buffer;
+        }
+
+        struct bcache_buffer *victim = coldest_unpinned();
+        if (!victim) {
+            spin_unlock_irqrestore(&bcache_lock, flags);
+            return nullptr;
+        }
+
+        if (victim->dirty) {
+            // the lookup is redone afterwards, someone may have brought the sector in meanwhile
+            victim->pins++;
+            victim->dirty = false;
+            spin_unlock_irqrestore(&bcache_lock, flags);
+            bool ok = blk_rw(victim->dev, BLK_WRITE, victim->lba, 1, victim->data);
+            flags = spin_lock_irqsave(&bcache_lock);
+            victim->pins--;
+            if (!ok) {
+                kprintf("bcache: write back of %s lba %lu failed\n", victim->dev->name, victim->lba);
+                victim->dirty = true;
+                lru_touch(&lru, &victim->lru);
+                spin_unlock_irqrestore(&bcache_lock, flags);
+                *failed = true;
+                return nullptr;
+            }
+            continue;
+        }
+
+        unhash(victim);
+        victim->dev = dev;
+        victim->lba = lba;
+        victim->valid = false;
+        victim->failed = false;
+        victim->pins = 1;
+        uint32_t bucket = bcache_hash(dev, lba);
+        victim->hash_next = buckets[bucket];
+        buckets[bucket] = victim;
+        lru_touch(&lru, &victim->lru);
+        spin_unlock_irqrestore(&bcache_lock, flags);
+        return victim;
+    }
+}
+
+// Waits for one to be unpinned, the caller holds no pins itself so somebody else is bound to let go
+static struct bcache_buffer *claim_wait(struct blk_device *dev, uint32_t lba) {
+    for (;;) {
+        bool failed;
+        struct bcache_buffer *buffer = claim(dev, lba, &failed);
+        if (buffer || failed) return buffer;
+
+        // a buffer let go of between the claim and here wouldn't wake us anymore
+        uint32_t flags = spin_lock_irqsave(&bcache_lock);
+        if (!coldest_unpinned()) sched_sleep_on(&bcache_waiters, &bcache_lock);
+        spin_unlock_irqrestore(&bcache_lock, flags);
+    }
+}
+
+static void release(struct bcache_buffer *buffer) {
+    uint32_t flags = spin_lock_irqsave(&bcache_lock);
+    buffer->pins--;
+    if (!buffer->pins) sched_wake_all(&bcache_waiters);
+    spin_unlock_irqrestore(&bcache_lock, flags);
+}
+
+bool bcache_read(struct blk_device *dev, uint32_t lba, uint32_t count, uint8_t *buffer) {
+    struct bcache_buffer *batch[BCACHE_BATCH];
+    struct blk_bio bios[BCACHE_BATCH];
+
+    while (count > 0) {
+        // claim what we can first, recycling a dirty buffer writes it back with blk_rw, which would never
+        // be dispatched while we hold the device plugged
+        uint32_t used = 0;
+        bool failed = false;
+        while (used < count && used < BCACHE_BATCH) {
+            struct bcache_buffer *cached = used ? claim(dev, lba + used, &failed) : claim_wait(dev, lba);
+            if (!cached) break;
+            batch[used++] = cached;
+        }
+
+        // the misses go out under one plug so neighbouring sectors merge
+        blk_plug(dev);
+        for (uint32_t i = 0; i < used; i++) {
+            uint32_t flags = spin_lock_irqsave(&bcache_lock);
+            bool fill = !batch[i]->valid && !batch[i]->busy;
+            if (fill) batch[i]->busy = true;
+            spin_unlock_irqrestore(&bcache_lock, flags);
+
+            if (fill) {
+                bios[i] = (struct blk_bio){
+                    .op = BLK_READ, .lba = lba + i, .count = 1, .buffer = batch[i]->data,
+                    .end = bcache_io_end, .private = batch[i],
+                };
+                blk_submit(dev, &bios[i]);
+            }
+        }
+        blk_unplug(dev);
+
+        bool ok = used > 0;
+        for (uint32_t i = 0; i < used; i++) {
+            uint32_t flags = spin_lock_irqsave(&bcache_lock);
+            wait_idle(batch[i]);
+            bool valid = batch[i]->valid;
+            spin_unlock_irqrestore(&bcache_lock, flags);
+
+            if (valid && ok) memcpy(buffer + i * BLK_SECTOR_SIZE, batch[i]->data, BLK_SECTOR_SIZE);
+            ok = ok && valid;
+            release(batch[i]);
+        }
+        if (!ok || failed) return false;
+
+        lba += used;
+        count -= used;
+        buffer += used * BLK_SECTOR_SIZE;
+    }
+    return true;
+}
+
+bool bcache_write(struct blk_device *dev, uint32_t lba, uint32_t count, const uint8_t *buffer) {
+    for (uint32_t i = 0; i < count; i++) {
+        struct bcache_buffer *cached = claim_wait(dev, lba + i);
+        if (!cached) return false;
+
+        // the whole sector is replaced, a miss doesn't have to be read first
+        uint32_t flags = spin_lock_irqsave(&bcache_lock);
+        wait_idle(cached);
+        memcpy(cached->data, buffer + i * BLK_SECTOR_SIZE, BLK_SECTOR_SIZE);
+        cached->valid = true;
+        cached->dirty = true;
+        spin_unlock_irqrestore(&bcache_lock, flags);
+        release(cached);
+    }
+    return true;
+}
+
+bool bcache_sync(struct blk_device *dev) {
+    struct bcache_buffer *batch[BCACHE_BATCH];
+    struct blk_bio bios[BCACHE_BATCH];
+    bool ok = true;
+
+    for (;;) {
+        uint32_t used = 0;
+        uint32_t flags = spin_lock_irqsave(&bcache_lock);
+        if (!initialized) bcache_setup();
+        for (uint32_t i = 0; i < BCACHE_BUFFERS && used < BCACHE_BATCH; i++) {
+            struct bcache_buffer *buffer = &buffers[i];
+            if (buffer->dirty && !buffer->busy && buffer->dev && (!dev || buffer->dev == dev)) {
+                // a write during the I/O sets it again
+                buffer->dirty = false;
+                buffer->busy = true;
+                buffer->pins++;
+                batch[used++] = buffer;
+            }
+        }
+        spin_unlock_irqrestore(&bcache_lock, flags);
+        if (used == 0) return ok;
+
+        // buffers of one device sitting next to each other on the disk merge into a single write
+        for (uint32_t i = 0; i < used; i++) {
+            if (i == 0 || batch[i]->dev != batch[i - 1]->dev) {
+                if (i) blk_unplug(batch[i - 1]->dev);
+                blk_plug(batch[i]->dev);
+            }
+            bios[i] = (struct blk_bio){
+                .op = BLK_WRITE, .lba = batch[i]->lba, .count = 1, .buffer = batch[i]->data,
+                .end = bcache_io_end, .private = batch[i],
+            };
+            blk_submit(batch[i]->dev, &bios[i]);
+        }
+        blk_unplug(batch[used - 1]->dev);
+
+        bool batch_ok = true;
+        for (uint32_t i = 0; i < used; i++) {
+            flags = spin_lock_irqsave(&bcache_lock);
+            wait_idle(batch[i]);
+            batch_ok = batch_ok && !batch[i]->failed;
+            spin_unlock_irqrestore(&bcache_lock, flags);
+            release(batch[i]);
+        }
+
+        // no point retrying in the next batch
+        if (!batch_ok) return false;
+    }
+}
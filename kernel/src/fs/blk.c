@@ -0,0 +1,191 @@
+#include <fs/blk.h>
+#include <proc/sched.h>
+
+static void blk_bio_init_request(struct blk_bio *bio) {
+    struct blk_request *request = &bio->request;
+    request->next = nullptr;
+    request->op = bio->op;
+    request->lba = bio->lba;
+    request->count = bio->count;
+    request->bios = request->last_bio = bio;
+}
+
+static bool blk_can_join(struct blk_device *dev, struct blk_request *request, enum blk_op op, uint32_t count) {
+    return request->op == op && request->count + count <= dev->max_sectors;
+}
+
+// Back merges may close the gap to the next request, which then joins too
+static void blk_merge_next(struct blk_device *dev, struct blk_request *request) {
+    struct blk_request *next = request->next;
+    if (!next || request->lba + request->count != next->lba || !blk_can_join(dev, request, next->op, next->count)) return;
+
+    request->last_bio->next = next->bios;
+    request->last_bio = next->last_bio;
+    request->count += next->count;
+    request->next = next->next;
+}
+
+static bool blk_merge(struct blk_device *dev, struct blk_bio *bio) {
+    for (struct blk_request *request = dev->queue; request; request = request->next) {
+        if (!blk_can_join(dev, request, bio->op, bio->count)) continue;
+
+        if (request->lba + request->count == bio->lba) {
+            request->last_bio->next = bio;
+            request->last_bio = bio;
+            request->count += bio->count;
+            blk_merge_next(dev, request);
+            return true;
+        }
+        if (bio->lba + bio->count == request->lba) {
+            // the queue stays sorted, whatever came before ends below the bio or it would have taken it above
+            bio->next = request->bios;
+            request->bios = bio;
+            request->lba = bio->lba;
+            request->count += bio->count;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void blk_insert(struct blk_device *dev, struct blk_request *request) {
+    struct blk_request **indirect = &dev->queue;
+    while (*indirect && (*indirect)->lba <= request->lba) indirect = &(*indirect)->next;
+    request->next = *indirect;
+    *indirect = request;
+}
+
+// C-LOOK: the lowest request at or above the head, wrapping around to the lowest one once nothing is left above
+static struct blk_request *blk_pick(struct blk_device *dev) {
+    struct blk_request **indirect = &dev->queue;
+    while (*indirect && (*indirect)->lba < dev->head) indirect = &(*indirect)->next;
+    if (!*indirect) indirect = &dev->queue;
+
+    struct blk_request *request = *indirect;
+    if (request) {
+        *indirect = request->next;
+        request->next = nullptr;
+    }
+    return request;
+}
+
+static void blk_run_queue(struct blk_device *dev) {
+    uint32_t flags = spin_lock_irqsave(&dev->lock);
+    // a synchronous driver completes from inside start, the loop below picks up the next request then
+    if (dev->dispatching) {
+        spin_unlock_irqrestore(&dev->lock, flags);
+        return;
+    }
+
+    dev->dispatching = true;
+    while (!dev->active && !dev->plugged && dev->queue) {
+        struct blk_request *request = blk_pick(dev);
+        dev->active = request;
+        dev->head = request->lba + request->count;
+        dev->dispatched++;
+
+        spin_unlock_irqrestore(&dev->lock, flags);
+        dev->start(dev, request);
+        flags = spin_lock_irqsave(&dev->lock);
+    }
+    dev->dispatching = false;
+    spin_unlock_irqrestore(&dev->lock, flags);
+}
+
+void blk_submit(struct blk_device *dev, struct blk_bio *bio) {
+    bio->next = nullptr;
+
+    uint32_t flags = spin_lock_irqsave(&dev->lock);
+    dev->submitted++;
+    if (blk_merge(dev, bio)) {
+        dev->merged++;
+    } else {
+        blk_bio_init_request(bio);
+        blk_insert(dev, &bio->request);
+    }
+    spin_unlock_irqrestore(&dev->lock, flags);
+
+    blk_run_queue(dev);
+}
+
+void blk_plug(struct blk_device *dev) {
+    uint32_t flags = spin_lock_irqsave(&dev->lock);
+    dev->plugged++;
+    spin_unlock_irqrestore(&dev->lock, flags);
+}
+
+void blk_unplug(struct blk_device *dev) {
+    uint32_t flags = spin_lock_irqsave(&dev->lock);
+    dev->plugged--;
+    spin_unlock_irqrestore(&dev->lock, flags);
+    blk_run_queue(dev);
+}
+
+void blk_end_request(struct blk_device *dev, struct blk_request *request, bool ok) {
+    uint32_t flags = spin_lock_irqsave(&dev->lock);
+    if (dev->active == request) dev->active = nullptr;
+    spin_unlock_irqrestore(&dev->lock, flags);
+
+    // the request sits inside one of the bios, which may be gone once its end ran
+    struct blk_bio *bio = request->bios;
+    while (bio) {
+        struct blk_bio *next = bio->next;
+        bio->end(bio, ok);
+        bio = next;
+    }
+
+    blk_run_queue(dev);
+}
+
+struct blk_waiter {
+    spinlock_t lock;
+    struct wait_queue queue;
+    uint32_t remaining;
+    bool ok;
+};
+
+static void blk_rw_end(struct blk_bio *bio, bool ok) {
+    struct blk_waiter *waiter = bio->private;
+    uint32_t flags = spin_lock_irqsave(&waiter->lock);
+    waiter->ok = waiter->ok && ok;
+    waiter->remaining--;
+    sched_wake_all(&waiter->queue);
+    spin_unlock_irqrestore(&waiter->lock, flags);
+}
+
+bool blk_rw(struct blk_device *dev, enum blk_op op, uint32_t lba, uint32_t count, uint8_t *buffer) {
+    struct blk_bio bios[BLK_RW_BATCH];
+    struct blk_waiter waiter = { SPINLOCK_INIT, { nullptr }, 0, true };
+
+    while (count > 0 && waiter.ok) {
+        // the pieces are cut at max_sectors, under the plug they merge back into as few commands as the driver allows
+        uint32_t used = 0;
+        waiter.remaining = 0;
+        blk_plug(dev);
+        while (count > 0 && used < BLK_RW_BATCH) {
+            struct blk_bio *bio = &bios[used++];
+            uint32_t length = count < dev->max_sectors ? count : dev->max_sectors;
+            *bio = (struct blk_bio){
+                .op = op, .lba = lba, .count = length, .buffer = buffer,
+                .end = blk_rw_end, .private = &waiter,
+            };
+
+            uint32_t flags = spin_lock_irqsave(&waiter.lock);
+            waiter.remaining++;
+            spin_unlock_irqrestore(&waiter.lock, flags);
+            blk_submit(dev, bio);
+
+            lba += length;
+            count -= length;
+            buffer += length * BLK_SECTOR_SIZE;
+        }
+        blk_unplug(dev);
+
+        uint32_t flags = spin_lock_irqsave(&waiter.lock);
+        while (waiter.remaining > 0) {
+            sched_sleep_on(&waiter.queue, &waiter.lock);
+        }
+        spin_unlock_irqrestore(&waiter.lock, flags);
+    }
+    return waiter.ok;
+}
@@ -0,0 +1,51 @@
+#include <fs/blkdev.h>
+#include <fs/bcache.h>
+#include <proc/pagecache.h>
+#include <kheap.h>
+#include <string.h>
+#include <io.h>
+
+#define BLKDEV_PAGE_SECTORS (PAGECACHE_PAGE_SIZE / BLK_SECTOR_SIZE)
+
+static struct blk_device *blkdev_of(struct vfs_node *node) {
+    return ((struct vfs_blkdev_node *)node)->dev;
+}
+
+// Through the buffer cache like the partitions, so sectors they wrote but haven't stored yet are seen
+static vfs_err_t blkdev_readpage(struct vfs_node *node, uint32_t index, uint8_t *page) {
+    vfs_off_t start = (vfs_off_t)index * PAGECACHE_PAGE_SIZE;
+    uint32_t length = node->size <= start ? 0 : node->size - start < PAGECACHE_PAGE_SIZE ? node->size - start : PAGECACHE_PAGE_SIZE;
+    if (length && !bcache_read(blkdev_of(node), index * BLKDEV_PAGE_SECTORS, length / BLK_SECTOR_SIZE, page)) return VFS_ERROR;
+
+    memset(page + length, 0, PAGECACHE_PAGE_SIZE - length);
+    return VFS_SUCCESS;
+}
+
+// The size is whole sectors, so is every length the page cache hands us. The buffers are stored right away,
+// a page written back is on the disk like it would be without the buffer cache in between.
+static vfs_err_t blkdev_writepage(struct vfs_node *node, uint32_t index, const uint8_t *page, uint32_t length) {
+    struct blk_device *dev = blkdev_of(node);
+    bool ok = bcache_write(dev, index * BLKDEV_PAGE_SECTORS, length / BLK_SECTOR_SIZE, page) && bcache_sync(dev);
+    return ok ? VFS_SUCCESS : VFS_ERROR;
+}
+
+struct vfs_node *blkdev_create(struct vfs_node *parent, const char *name, struct blk_device *dev, uint32_t sectors) {
+    struct vfs_blkdev_node *blkdev = kmalloc(sizeof(struct vfs_blkdev_node));
+    if (!blkdev) return nullptr;
+    memset(blkdev, 0, sizeof(struct vfs_blkdev_node));
+    blkdev->dev = dev;
+
+    struct vfs_node *node = &blkdev->base;
+    node->name = strdup(name);
+    node->type = VFS_BLOCK_DEVICE;
+    node->size = (vfs_off_t)sectors * BLK_SECTOR_SIZE;
+    node->fixed_size = true;
+    node->permissions = VFS_READ | VFS_WRITE;
+    node->creation_time = node->modification_time = get_rtc_timestamp();
+    node->parent = parent;
+    node->readpage = blkdev_readpage;
+    node->writepage = blkdev_writepage;
+
+    vfs_insert_node(parent, node);
+    return node;
+}
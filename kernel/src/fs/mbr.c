@@ -1,5 +1,6 @@
 #include <fs/ata.h>
 #include <fs/mbr.h>
+#include <fs/bcache.h>
 #include <stdbool.h>
 #include <kheap.h>
 #include <kprintf>
@@ -11,7 +12,7 @@ void mbr_parse()
 {
     boot_mbr = 0;
     mbr_header_t mbr_;
-    ata_read_sectors_pio((uint8_t*)&mbr_, 0, 1);
+    blk_rw(&ata_disk, BLK_READ, 0, 1, (uint8_t*)&mbr_);
     if (mbr_.signature != MBR_SIGNATURE) {
         kprintf("MBR signature not found: 0x%x\n", mbr_.signature);
     }
@@ -27,18 +28,21 @@ void mbr_parse()
 
 bool mbr_read_sector(partition_t* disk, uint32_t lba, uint8_t sectors, uint8_t* lowerDataOut)
 {
-	if (lba+disk->lba_offset >=disk->part_size) {
+	if (lba >= disk->part_size || sectors > disk->part_size - lba) {
 		return false;
 	}
-	ata_read_sectors_pio(lowerDataOut, (lba+disk->lba_offset), sectors);
-	return true;
+	return bcache_read(&ata_disk, lba+disk->lba_offset, sectors, lowerDataOut);
 }
 
 bool mbr_write_sector(partition_t* disk, uint32_t lba, uint8_t sectors, uint8_t* lowerDataIn)
 {
-	if (lba+disk->lba_offset >=disk->part_size) {
+	if (lba >= disk->part_size || sectors > disk->part_size - lba) {
 		return false;
 	}
-	ata_write_sectors_pio(lba+disk->lba_offset, sectors, lowerDataIn);
-	return true;
-}
\ No newline at end of file
+	return bcache_write(&ata_disk, lba+disk->lba_offset, sectors, lowerDataIn);
+}
+
+bool mbr_sync()
+{
+	return bcache_sync(&ata_disk);
+}
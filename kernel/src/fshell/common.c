@@ -3,7 +3,12 @@
 #include <kprintf>
 #include <proc/vfs.h>
 #include <proc/ramfs.h>
-#include <sys/pic.h>
+#include <proc/sched_trace.h>
+#include <proc/elf.h>
+#include <proc/workqueue.h>
+#include <proc/spinlock.h>
+#include <sys/idt.h>
+#include <sys/syscall.h>
 #include <fshell/framebuffer.h>
 
 struct fshell_ctx fshell_ctx;
@@ -25,16 +30,26 @@ const char* scancodeToASCII_shift[256] = {
     "", " ", "", "", "", "", "", "", "", "", "", "", "", "", ""
 };
 
+// Raw scancodes IRQ 1 left for keyboard_work, which turns them into characters in fshell_ctx.buffer
+#define FSHELL_SCANCODES 64
+static uint8_t scancodes[FSHELL_SCANCODES];
+static uint32_t scancode_head;
+static uint32_t scancode_count;
+// Guards the scancodes and fshell_ctx's character buffer
+static spinlock_t input_lock = SPINLOCK_INIT;
+
 char getchar_locking() {
     while (fshell_ctx.count == 0)
         yield();
+    uint32_t flags = spin_lock_irqsave(&input_lock);
     char c = fshell_ctx.buffer[(fshell_ctx.buffer_index - fshell_ctx.count + FSHELL_BUFFER_SIZE) % FSHELL_BUFFER_SIZE];
     fshell_ctx.count--;
+    spin_unlock_irqrestore(&input_lock, flags);
     return c;
 }
 
-void fshell_interrupt_handler(registers_t* ) {
-    uint8_t scancode = inb(0x60);
+// With input_lock held
+static void decode_scancode(uint8_t scancode) {
     if (scancode & 0x80) {
         scancode &= 0x7F;
         if (scancode == 0x2A || scancode == 0x36) {
@@ -57,7 +72,32 @@ void fshell_interrupt_handler(registers_t* ) {
             }
         }
     }
-    pic_sendeoi(1);
+}
+
+static void keyboard_work_func(struct work *) {
+    uint32_t flags = spin_lock_irqsave(&input_lock);
+    while (scancode_count > 0) {
+        decode_scancode(scancodes[scancode_head]);
+        scancode_head = (scancode_head + 1) % FSHELL_SCANCODES;
+        scancode_count--;
+    }
+    spin_unlock_irqrestore(&input_lock, flags);
+}
+
+static struct work keyboard_work = { .func = keyboard_work_func };
+
+// Only takes the scancode off the controller, decoding runs on system_wq
+void fshell_interrupt_handler(registers_t* ) {
+    uint8_t scancode = inb(0x60);
+    spin_lock(&input_lock);
+    if (scancode_count < FSHELL_SCANCODES) {
+        scancodes[(scancode_head + scancode_count) % FSHELL_SCANCODES] = scancode;
+        scancode_count++;
+    }
+    spin_unlock(&input_lock);
+
+    // before workqueue_init the scancodes wait for the next key
+    if (system_wq) queue_work(system_wq, &keyboard_work);
 }
 
 static void trim_whitespace(char *str) {
@@ -119,7 +159,7 @@ static void resolve_path(char *resolved_path, const char *path) {
     }
 }
 
-#define COMMAND_COUNT 10
+#define COMMAND_COUNT 15
 
 typedef struct {
     const char *name;
@@ -136,6 +176,11 @@ static void command_cat(char *args);
 static void command_touch(char *args);
 static void command_rm(char *args);
 static void command_rmdir(char *args);
+static void command_sync(char *args);
+static void command_irqstat(char *args);
+static void command_schedtrace(char *args);
+static void command_top(char *args);
+static void command_exec(char *args);
 
 command_t commands[COMMAND_COUNT] = {
     {"help", command_help},
@@ -147,7 +192,12 @@ command_t commands[COMMAND_COUNT] = {
     {"cd", command_cd},
     {"touch", command_touch},
     {"rm", command_rm},
-    {"rmdir", command_rmdir}
+    {"rmdir", command_rmdir},
+    {"sync", command_sync},
+    {"irqstat", command_irqstat},
+    {"schedtrace", command_schedtrace},
+    {"top", command_top},
+    {"exec", command_exec}
 };
 
 static HANDLE handle_redirection(char *args, int *write_mode) {
@@ -183,6 +233,15 @@ static HANDLE handle_redirection(char *args, int *write_mode) {
     return handle;
 }
 
+// Prints to the console, or to the redirection target when there is one
+static void emit(HANDLE output_handle, int *offset, const char *text) {
+    if (output_handle) {
+        write(output_handle, *offset, strlen(text), (const uint8_t *)text);
+        *offset += strlen(text);
+    } else {
+        puts(text);
+    }
+}
 
 void command_help(char *args) {
     int write_mode = WRITE_MODE_TRUNCATE;
@@ -191,10 +250,9 @@ void command_help(char *args) {
 
     for (int i = 0; i < COMMAND_COUNT; i++) {
         if (output_handle) {
-            write(output_handle, offset, strlen(commands[i].name), (uint8_t *)commands[i].name);
-            offset += strlen(commands[i].name);
-            write(output_handle, offset, 1, (uint8_t *)"\n");
-            offset += 1;
+            struct vfs_iovec iov[] = { { (void *)commands[i].name, strlen(commands[i].name) }, { "\n", 1 } };
+            int64_t written = pwritev(output_handle, iov, 2, offset);
+            if (written > 0) offset += written;
         } else {
             puts(commands[i].name);
             puts("\n");
@@ -216,9 +274,8 @@ void command_echo(char *args) {
     int offset = (write_mode == WRITE_MODE_APPEND && output_handle) ? output_handle->size : 0;
 
     if (output_handle) {
-        write(output_handle, offset, strlen(args), (uint8_t *)args);
-        offset += strlen(args);
-        write(output_handle, offset, 1, (uint8_t *)"\n");
+        struct vfs_iovec iov[] = { { args, strlen(args) }, { "\n", 1 } };
+        pwritev(output_handle, iov, 2, offset);
         close(output_handle);
     } else {
         puts(args);
@@ -245,28 +302,42 @@ void command_cat(char *args) {
 
     HANDLE handle = open(full_path);
     if (!handle) {
-        if (!output_handle) puts("File not found.\n");
-        else write(output_handle, offset, 15, (uint8_t *)"File not found.\n");
+        emit(output_handle, &offset, "File not found.\n");
+        if (output_handle) close(output_handle);
         return;
     }
 
     if (handle->type != VFS_RAMFS_FILE) {
-        if (!output_handle) puts("Not a file.\n");
-        else write(output_handle, offset, 11, (uint8_t *)"Not a file.\n");
+        emit(output_handle, &offset, "Not a file.\n");
+        if (output_handle) close(output_handle);
         close(handle);
         return;
     }
 
+    // straight from the file's storage where the filesystem allows it, through a bounce buffer otherwise
     uint8_t buffer[FSHELL_BUFFER_SIZE];
-    vfs_read(handle, 0, handle->size, buffer);
-    if (output_handle) {
-        write(output_handle, offset, handle->size, buffer);
-        close(output_handle);
-    } else {
-        puts((char *)buffer);
-        puts("\n");
+    uint32_t position = 0;
+    while (position < handle->size) {
+        const uint8_t *data;
+        uint32_t length;
+        if (read_direct(handle, position, &data, &length) != VFS_SUCCESS || length == 0) {
+            length = handle->size - position < sizeof(buffer) ? handle->size - position : sizeof(buffer);
+            if (vfs_read(handle, position, length, buffer) != VFS_SUCCESS) break;
+            data = buffer;
+        }
+
+        if (output_handle) {
+            write(output_handle, offset, length, data);
+            offset += length;
+        } else {
+            for (uint32_t i = 0; i < length; i++) putc(data[i]);
+        }
+        position += length;
     }
 
+    if (output_handle) close(output_handle);
+    else puts("\n");
+
     close(handle);
 }
 
@@ -363,6 +434,10 @@ void command_rmdir(char *args) {
     close(handle);
 }
 
+void command_sync(char *) {
+    if (sync() != VFS_SUCCESS) puts("Some data couldn't be written back.\n");
+}
+
 void command_ls(char *args) {
     int write_mode = WRITE_MODE_TRUNCATE;
     HANDLE output_handle = handle_redirection(args, &write_mode);
@@ -373,14 +448,14 @@ void command_ls(char *args) {
 
     HANDLE handle = open(full_path);
     if (!handle) {
-        if (!output_handle) puts("Directory not found.\n");
-        else write(output_handle, offset, 17, (uint8_t *)"Directory not found.\n");
+        emit(output_handle, &offset, "Directory not found.\n");
+        if (output_handle) close(output_handle);
         return;
     }
 
     if (handle->type != VFS_RAMFS_FOLDER) {
-        if (!output_handle) puts("Not a directory.\n");
-        else write(output_handle, offset, 16, (uint8_t *)"Not a directory.\n");
+        emit(output_handle, &offset, "Not a directory.\n");
+        if (output_handle) close(output_handle);
         close(handle);
         return;
     }
@@ -390,10 +465,9 @@ void command_ls(char *args) {
         char *name = child->name;
         if (child->type == VFS_RAMFS_FOLDER) set_foreground_color(0xBB7799);
         if (output_handle) {
-            write(output_handle, offset, strlen(name), (uint8_t *)name);
-            offset += strlen(name);
-            write(output_handle, offset, 1, (uint8_t *)" ");
-            offset += 1;
+            struct vfs_iovec iov[] = { { name, strlen(name) }, { " ", 1 } };
+            int64_t written = pwritev(output_handle, iov, 2, offset);
+            if (written > 0) offset += written;
         } else {
             puts(name);
             puts(" ");
@@ -452,6 +526,222 @@ static void command_cd(char *args) {
     close(handle);
 }
 
+static void vector_name(int vector, char *buffer, size_t size) {
+    if (vector < 32) ksnprintf(buffer, size, "exception %d", vector);
+    else if (vector < PIC_REMAP_OFFSET + 16) ksnprintf(buffer, size, "IRQ %d", vector - PIC_REMAP_OFFSET);
+    else if (vector == SCHED_YIELD_VECTOR) ksnprintf(buffer, size, "yield");
+    else if (vector == SYSCALL_VECTOR) ksnprintf(buffer, size, "syscall");
+    else if (vector == SCHED_IPI_VECTOR) ksnprintf(buffer, size, "resched IPI");
+    else if (vector == LAPIC_TIMER_VECTOR) ksnprintf(buffer, size, "APIC timer");
+    else if (vector == LAPIC_SPURIOUS_VECTOR) ksnprintf(buffer, size, "APIC spurious");
+    else ksnprintf(buffer, size, "-");
+}
+
+void command_irqstat(char *args) {
+    int write_mode = WRITE_MODE_TRUNCATE;
+    HANDLE output_handle = handle_redirection(args, &write_mode);
+    int offset = (write_mode == WRITE_MODE_APPEND && output_handle) ? output_handle->size : 0;
+
+    char line[128];
+    char name[24];
+    emit(output_handle, &offset, "vector  source          count       avg cycles  max cycles  spurious\n");
+    for (int vector = 0; vector < 256; vector++) {
+        irq_stat_t stat;
+        idt_get_stats(vector, &stat);
+        if (stat.count == 0) continue;
+
+        vector_name(vector, name, sizeof(name));
+        if (stat.max_cycles == 0) {
+            // counted but not timed, see irq_stat_t
+            ksnprintf(line, sizeof(line), "0x%02x    %-14s  %-10llu  %-10s  %-10s  %llu\n",
+                      vector, name, stat.count, "-", "-", stat.spurious);
+        } else {
+            ksnprintf(line, sizeof(line), "0x%02x    %-14s  %-10llu  %-10llu  %-10llu  %llu\n",
+                      vector, name, stat.count, stat.cycles / stat.count, stat.max_cycles, stat.spurious);
+        }
+        emit(output_handle, &offset, line);
+    }
+
+    if (output_handle) close(output_handle);
+}
+
+struct emit_target {
+    HANDLE handle;
+    int offset;
+};
+
+static void emit_line(const char *line, void *arg) {
+    struct emit_target *target = arg;
+    emit(target->handle, &target->offset, line);
+}
+
+static void debugcon_line(const char *line, void *) {
+    kprintf("%s", line);
+}
+
+void command_schedtrace(char *args) {
+    int write_mode = WRITE_MODE_TRUNCATE;
+    HANDLE output_handle = handle_redirection(args, &write_mode);
+    struct emit_target target = {
+        output_handle, (write_mode == WRITE_MODE_APPEND && output_handle) ? (int)output_handle->size : 0
+    };
+    if (args) trim_whitespace(args);
+
+    if (args == NULL || strlen(args) == 0 || strcmp(args, "hist") == 0) {
+        sched_trace_histograms(emit_line, &target);
+    } else if (strcmp(args, "dump") == 0) {
+        // the ring holds thousands of lines, without a file they go to the debug console
+        if (output_handle) sched_trace_dump(emit_line, &target);
+        else sched_trace_dump(debugcon_line, nullptr);
+    } else if (strcmp(args, "on") == 0) {
+        sched_trace_enabled = true;
+    } else if (strcmp(args, "off") == 0) {
+        sched_trace_enabled = false;
+    } else if (strcmp(args, "clear") == 0) {
+        sched_trace_clear();
+    } else {
+        puts("Usage: schedtrace [hist|dump|on|off|clear] [> file]\n");
+    }
+
+    if (output_handle) close(output_handle);
+}
+
+#define TOP_MAX_TASKS 64
+#define TOP_INTERVAL_MS 1000
+#define TOP_POLL_MS 50
+
+static const char *const task_state_names[] = {
+    [TASK_RUNNING] = "R", [TASK_READY] = "Q", [TASK_WAITING] = "W", [TASK_BLOCKED] = "S", [TASK_TERMINATED] = "Z",
+};
+
+static const char *const policy_names[] = {
+    [SCHED_DEADLINE] = "DL", [SCHED_FIFO] = "FIFO", [SCHED_FAIR] = "FAIR", [SCHED_RR] = "RR",
+};
+
+static uint64_t cycles_to_ms(uint64_t cycles) {
+    return cycles / ((tsc_frequency ? tsc_frequency : 1000000000) / 1000);
+}
+
+static const struct task_info *find_info(const struct task_info *tasks, uint32_t count, uint32_t pid) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (tasks[i].pid == pid) return &tasks[i];
+    }
+    return nullptr;
+}
+
+static void top_render(const struct task_info *prev, uint32_t prev_count, const struct task_info *curr,
+                       uint32_t count, uint64_t elapsed) {
+    uint64_t used[TOP_MAX_TASKS];
+    uint32_t order[TOP_MAX_TASKS];
+    uint64_t busy = 0;
+    uint32_t online = 0;
+    for (uint32_t i = 0; i < cpu_count; i++) online += cpus[i].online;
+
+    // cycles each task got during the interval, busiest first
+    for (uint32_t i = 0; i < count; i++) {
+        const struct task_info *before = find_info(prev, prev_count, curr[i].pid);
+        uint64_t total = curr[i].user_cycles + curr[i].kernel_cycles;
+        used[i] = before ? total - (before->user_cycles + before->kernel_cycles) : total;
+        if (!curr[i].idle) busy += used[i];
+
+        uint32_t j = i;
+        while (j > 0 && used[order[j - 1]] < used[i]) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    char line[128];
+    cls();
+    ksnprintf(line, sizeof(line), "top - %lu cpus, %lu tasks, %llu%% busy, any key quits\n\n",
+              online, count, busy * 100 / (elapsed * online));
+    puts(line);
+    puts("  PID  PPID CPU S POLICY  %CPU     USER ms     KERN ms    VOLCS  INVOLCS  WAKEUPS\n");
+
+    uint32_t rows = framebuffer->fb.height / FONT_HEIGHT - 4;
+    for (uint32_t n = 0; n < count && n < rows; n++) {
+        const struct task_info *task = &curr[order[n]];
+        uint64_t permille = used[order[n]] * 1000 / elapsed;
+        if (permille > 1000) permille = 1000;
+
+        ksnprintf(line, sizeof(line), "%5lu %5lu %3lu %s %-6s %3llu.%llu %11llu %11llu %8lu %8lu %8lu\n",
+                  task->pid, task->ppid, task->last_cpu, task_state_names[task->state],
+                  task->idle ? "idle" : policy_names[task->policy], permille / 10, permille % 10,
+                  cycles_to_ms(task->user_cycles), cycles_to_ms(task->kernel_cycles),
+                  task->voluntary_switches, task->involuntary_switches, task->wakeups);
+        puts(line);
+    }
+}
+
+void command_top(char *) {
+    struct task_info *prev = kmalloc(sizeof(struct task_info) * TOP_MAX_TASKS);
+    struct task_info *curr = kmalloc(sizeof(struct task_info) * TOP_MAX_TASKS);
+    if (!prev || !curr) {
+        puts("top: out of memory\n");
+        if (prev) kfree(prev);
+        if (curr) kfree(curr);
+        return;
+    }
+
+    uint64_t start = rdtsc();
+    uint32_t prev_count = sched_snapshot(prev, TOP_MAX_TASKS);
+    while (fshell_ctx.count == 0) {
+        for (uint32_t waited = 0; waited < TOP_INTERVAL_MS && fshell_ctx.count == 0; waited += TOP_POLL_MS) {
+            sched_sleep(TOP_POLL_MS);
+        }
+
+        uint64_t now = rdtsc();
+        uint32_t count = sched_snapshot(curr, TOP_MAX_TASKS);
+        top_render(prev, prev_count, curr, count, now - start ? now - start : 1);
+
+        struct task_info *swap = prev;
+        prev = curr;
+        curr = swap;
+        prev_count = count;
+        start = now;
+    }
+
+    getchar_locking();
+    kfree(prev);
+    kfree(curr);
+    cls();
+}
+
+void command_exec(char *args) {
+    const char *argv[ELF_MAX_ARGS];
+    int argc = 0;
+    for (char *token = args ? strtok(args, " ") : NULL; token && argc < ELF_MAX_ARGS; token = strtok(NULL, " ")) {
+        argv[argc++] = token;
+    }
+    if (argc == 0) {
+        puts("Usage: exec <path> [args...]\n");
+        return;
+    }
+
+    char full_path[FSHELL_BUFFER_SIZE];
+    resolve_path(full_path, argv[0]);
+
+    struct task *task = elf_exec(full_path, argc, argv, current_task->pid);
+    if (!task) {
+        puts("exec: cannot run ");
+        puts(full_path);
+        puts("\n");
+        return;
+    }
+
+    uint32_t pid = task->pid;
+    sched_add_task(task);
+
+    int code = 0;
+    sched_wait(pid, &code);
+    if (code != 0) {
+        char line[64];
+        ksnprintf(line, sizeof(line), "[%lu exited with %d]\n", pid, code);
+        puts(line);
+    }
+}
+
 extern void text_editor(const char* path);
 
 void execute_command(const char *command, char *args) {
@@ -484,7 +774,7 @@ void fshell_callback() {
     int index = 0;
     strcpy(fshell_ctx.pwd, "/");
 
-    pic_unmask(1);
+    irq_unmask(1);
     cls();
     puts(fshell_ctx.pwd);
     puts("> ");
@@ -531,5 +821,5 @@ void fshell_callback() {
     }
 
     puts("Shell terminated\n");
-    sched_remove_task(current_task->pid);
+    task_exit(0);
 }
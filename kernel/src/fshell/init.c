@@ -1,8 +1,8 @@
 #include <fshell/init.h>
 #include <fshell/common.h>
-#include <sys/pic.h>
+#include <sys/idt.h>
 
 void init_fshell() {
     irq_register_handler(1, fshell_interrupt_handler);
-    pic_mask(1);
+    irq_mask(1);
 }
\ No newline at end of file
@@ -0,0 +1,42 @@
+#include <proc/dcache.h>
+#include <proc/spinlock.h>
+#include <string.h>
+
+static struct vfs_dentry dcache[VFS_DCACHE_ENTRIES];
+static spinlock_t dcache_lock = SPINLOCK_INIT;
+// Starts at 1 so the zeroed table holds no valid entry
+static uint32_t dcache_generation = 1;
+
+uint32_t vfs_dcache_generation() {
+    return __atomic_load_n(&dcache_generation, __ATOMIC_ACQUIRE);
+}
+
+void vfs_dcache_invalidate() {
+    __atomic_add_fetch(&dcache_generation, 1, __ATOMIC_RELEASE);
+}
+
+struct vfs_node *vfs_dcache_lookup(struct vfs_tree *tree, const char *path, uint32_t hash) {
+    struct vfs_dentry *entry = &dcache[hash % VFS_DCACHE_ENTRIES];
+    struct vfs_node *node = nullptr;
+
+    uint32_t flags = spin_lock_irqsave(&dcache_lock);
+    if (entry->generation == vfs_dcache_generation() && entry->hash == hash && entry->tree == tree &&
+        strcmp(entry->path, path) == 0) {
+        node = entry->node;
+    }
+    spin_unlock_irqrestore(&dcache_lock, flags);
+    return node;
+}
+
+void vfs_dcache_insert(struct vfs_tree *tree, const char *path, uint32_t hash, uint32_t generation, struct vfs_node *node) {
+    if (strlen(path) >= VFS_DCACHE_PATH_MAX) return;
+    struct vfs_dentry *entry = &dcache[hash % VFS_DCACHE_ENTRIES];
+
+    uint32_t flags = spin_lock_irqsave(&dcache_lock);
+    entry->tree = tree;
+    entry->hash = hash;
+    entry->generation = generation;
+    entry->node = node;
+    strcpy(entry->path, path);
+    spin_unlock_irqrestore(&dcache_lock, flags);
+}
@@ -0,0 +1,201 @@
+#include <proc/elf.h>
+#include <proc/sched.h>
+#include <proc/vfs.h>
+#include <sys/idt.h>
+#include <sys/mm/pmm.h>
+#include <sys/mm/vmm.h>
+#include <kheap.h>
+#include <string.h>
+#include <kprintf>
+#include <io.h>
+
+#define PAGE_FAULT_VECTOR 14
+#define PAGE_FAULT_PRESENT 0x1
+
+static bool segment_overlaps(const struct user_segment *segment, uint32_t start, uint32_t end) {
+    return segment->vaddr < end && segment->vaddr + segment->memsz > start;
+}
+
+// Fills a fresh frame from every segment that shares the page, linkers like to put the end of
+// one segment and the start of the next on the same page
+bool elf_fault_in(struct task *task, uint32_t address) {
+    uint32_t page = ROUND_DOWN_TO_PAGE(address);
+    uint32_t flags = PAGE_PRESENT | PAGE_USER;
+    bool covered = false;
+    for (uint32_t i = 0; i < task->segment_count; i++) {
+        if (segment_overlaps(&task->segments[i], page, page + PAGE_SIZE)) {
+            covered = true;
+            if (task->segments[i].writable) flags |= PAGE_RW;
+        }
+    }
+    if (!covered) return false;
+
+    void *frame = pmm_alloc();
+    if (!frame) return false;
+    uint8_t *data = (uint8_t *)frame + higher_half_base;
+    memset(data, 0, PAGE_SIZE);
+
+    bool ok = true;
+    for (uint32_t i = 0; i < task->segment_count && ok; i++) {
+        const struct user_segment *segment = &task->segments[i];
+        uint32_t start = segment->vaddr > page ? segment->vaddr : page;
+        uint32_t end = segment->vaddr + segment->filesz;
+        if (end > page + PAGE_SIZE) end = page + PAGE_SIZE;
+        if (start >= end) continue;
+
+        ok = read(task->image, segment->offset + (start - segment->vaddr), end - start, data + (start - page)) == VFS_SUCCESS;
+    }
+
+    if (!ok || !vmm_map_page(&task->cr3, page, PAGE_SIZE, (uintptr_t)frame, flags)) {
+        pmm_free(frame);
+        return false;
+    }
+    return true;
+}
+
+static void page_fault_handler(registers_t *regs) {
+    uint32_t address;
+    __asm__ volatile ("mov %%cr2, %0" : "=r" (address));
+
+    // only faults from ring 3 are served here, interrupts were on there and nothing in the kernel is held.
+    // The kernel reaches user memory through the uaccess helpers, which fault pages in themselves, so any
+    // other fault from ring 0 is a kernel bug and ends up in idt_unhandled_exception.
+    struct task *task = current_task;
+    if ((regs->cs & 3) == 3 && !(regs->error & PAGE_FAULT_PRESENT) && task && task->segments && address < higher_half_base) {
+        // the read may have to wait for the disk
+        sti();
+        bool loaded = elf_fault_in(task, address);
+        cli();
+        if (loaded) return;
+    }
+    idt_unhandled_exception(regs);
+}
+
+void elf_init() {
+    idt_register_handler(PAGE_FAULT_VECTOR, page_fault_handler);
+}
+
+// Writes into an address space that isn't loaded, through the frames' higher half mapping
+static bool copy_to(vmm_context_t *cr3, uint32_t address, const void *source, uint32_t size) {
+    const uint8_t *bytes = source;
+    while (size > 0) {
+        uintptr_t phys = vmm_virt_to_phys(cr3, address);
+        if (!phys) return false;
+
+        uint32_t chunk = PAGE_SIZE - (address & ~PAGE_MASK);
+        if (chunk > size) chunk = size;
+        memcpy((uint8_t *)(phys + higher_half_base), bytes, chunk);
+        address += chunk;
+        bytes += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+// Lays out argc, argv, a null argv terminator and an empty envp under the strings at the stack top
+static uint32_t push_args(vmm_context_t *cr3, uint32_t sp, int argc, const char **argv) {
+    uint32_t pointers[ELF_MAX_ARGS + 3];
+    for (int i = argc - 1; i >= 0; i--) {
+        uint32_t length = strlen(argv[i]) + 1;
+        sp -= length;
+        if (!copy_to(cr3, sp, argv[i], length)) return 0;
+        pointers[i + 1] = sp;
+    }
+    pointers[0] = argc;
+    pointers[argc + 1] = 0;
+    pointers[argc + 2] = 0;
+
+    sp &= ~3u;
+    sp -= (argc + 3) * sizeof(uint32_t);
+    return copy_to(cr3, sp, pointers, (argc + 3) * sizeof(uint32_t)) ? sp : 0;
+}
+
+static bool check_header(const elf32_ehdr_t *header) {
+    return header->magic == ELF_MAGIC && header->class == ELF_CLASS_32 && header->data == ELF_DATA_LSB &&
+           header->type == ELF_TYPE_EXEC && header->machine == ELF_MACHINE_386 &&
+           header->phentsize == sizeof(elf32_phdr_t) && header->phnum > 0 && header->phnum <= ELF_MAX_PHDRS;
+}
+
+static struct user_segment *load_segments(HANDLE node, const elf32_ehdr_t *header, uint32_t *count) {
+    elf32_phdr_t phdrs[ELF_MAX_PHDRS];
+    uint32_t size = header->phnum * sizeof(elf32_phdr_t);
+    if (header->phoff > node->size || size > node->size - header->phoff) return nullptr;
+    if (read(node, header->phoff, size, (uint8_t *)phdrs) != VFS_SUCCESS) return nullptr;
+
+    struct user_segment *segments = kmalloc(sizeof(struct user_segment) * header->phnum);
+    if (!segments) return nullptr;
+
+    *count = 0;
+    for (uint32_t i = 0; i < header->phnum; i++) {
+        const elf32_phdr_t *phdr = &phdrs[i];
+        if (phdr->type != ELF_PT_LOAD || phdr->memsz == 0) continue;
+
+        // everything has to stay clear of the stack and the kernel half, and the file part inside the file
+        bool valid = phdr->filesz <= phdr->memsz && phdr->vaddr + phdr->memsz > phdr->vaddr &&
+                     phdr->vaddr + phdr->memsz <= USER_STACK_TOP - USER_STACK_SIZE &&
+                     phdr->offset <= node->size && phdr->filesz <= node->size - phdr->offset;
+        if (!valid) {
+            kfree(segments);
+            return nullptr;
+        }
+
+        // i586 paging can't refuse execution, PF_X and PF_R both come down to a present page
+        segments[*count] = (struct user_segment){
+            .vaddr = phdr->vaddr,
+            .memsz = phdr->memsz,
+            .offset = phdr->offset,
+            .filesz = phdr->filesz,
+            .writable = (phdr->flags & ELF_PF_W) != 0,
+        };
+        (*count)++;
+    }
+    return segments;
+}
+
+struct task *elf_exec(const char *path, int argc, const char **argv, uint32_t ppid) {
+    if (argc < 0 || argc > ELF_MAX_ARGS) return nullptr;
+
+    HANDLE node = open(path);
+    if (!node) {
+        kprintf("elf: %s not found\n", path);
+        return nullptr;
+    }
+
+    elf32_ehdr_t header;
+    if (node->size < sizeof(header) || read(node, 0, sizeof(header), (uint8_t *)&header) != VFS_SUCCESS || !check_header(&header)) {
+        kprintf("elf: %s is not an i386 executable\n", path);
+        close(node);
+        return nullptr;
+    }
+
+    uint32_t segment_count = 0;
+    struct user_segment *segments = load_segments(node, &header, &segment_count);
+    if (!segments || segment_count == 0) {
+        kprintf("elf: %s has bad program headers\n", path);
+        if (segments) kfree(segments);
+        close(node);
+        return nullptr;
+    }
+
+    vmm_context_t cr3;
+    if (!vmm_create_pd(&cr3)) {
+        kfree(segments);
+        close(node);
+        return nullptr;
+    }
+
+    uint32_t sp = task_map_user_stack(&cr3);
+    if (sp) sp = push_args(&cr3, sp, argc, argv);
+    struct task *task = sp ? task_create_user(header.entry, sp, ppid, 0, cr3) : nullptr;
+    if (!task) {
+        vmm_destroy_pd(&cr3);
+        kfree(segments);
+        close(node);
+        return nullptr;
+    }
+
+    task->image = node;
+    task->segments = segments;
+    task->segment_count = segment_count;
+    return task;
+}
@@ -0,0 +1,130 @@
+#include <proc/file.h>
+#include <proc/task.h>
+#include <proc/ramfs.h>
+#include <fs/blkdev.h>
+#include <kheap.h>
+#include <string.h>
+
+struct vfs_file *vfs_file_open(const char *path, uint32_t flags) {
+    HANDLE node = open(path);
+    if (!node && (flags & VFS_O_CREATE)) {
+        if (create(path, VFS_RAMFS_FILE) != VFS_SUCCESS) return nullptr;
+        node = open(path);
+    }
+    if (!node) return nullptr;
+
+    if (node->type != VFS_RAMFS_FILE && node->type != VFS_BLOCK_DEVICE) {
+        close(node);
+        return nullptr;
+    }
+
+    struct vfs_file *file = kmalloc(sizeof(struct vfs_file));
+    if (!file) {
+        close(node);
+        return nullptr;
+    }
+
+    file->node = node;
+    file->offset = 0;
+    file->flags = flags;
+    file->refcount = 1;
+    mutex_init(&file->lock);
+    return file;
+}
+
+struct vfs_file *vfs_file_get(struct vfs_file *file) {
+    if (file) __atomic_add_fetch(&file->refcount, 1, __ATOMIC_RELAXED);
+    return file;
+}
+
+void vfs_file_put(struct vfs_file *file) {
+    if (!file || __atomic_sub_fetch(&file->refcount, 1, __ATOMIC_ACQ_REL) != 0) return;
+
+    close(file->node);
+    kfree(file);
+}
+
+int64_t vfs_file_readv(struct vfs_file *file, const struct vfs_iovec *iov, uint32_t count) {
+    if (!(file->flags & VFS_O_READ)) return -1;
+
+    mutex_lock(&file->lock);
+    int64_t done = preadv(file->node, iov, count, file->offset);
+    if (done > 0) file->offset += done;
+    mutex_unlock(&file->lock);
+    return done;
+}
+
+int64_t vfs_file_writev(struct vfs_file *file, const struct vfs_iovec *iov, uint32_t count) {
+    if (!(file->flags & VFS_O_WRITE)) return -1;
+
+    mutex_lock(&file->lock);
+    if (file->flags & VFS_O_APPEND) file->offset = file->node->size;
+    int64_t done = pwritev(file->node, iov, count, file->offset);
+    if (done > 0) file->offset += done;
+    mutex_unlock(&file->lock);
+    return done;
+}
+
+int64_t vfs_file_read(struct vfs_file *file, void *buffer, size_t size) {
+    struct vfs_iovec iov = { buffer, size };
+    return vfs_file_readv(file, &iov, 1);
+}
+
+int64_t vfs_file_write(struct vfs_file *file, const void *buffer, size_t size) {
+    struct vfs_iovec iov = { (void *)buffer, size };
+    return vfs_file_writev(file, &iov, 1);
+}
+
+int64_t vfs_file_seek(struct vfs_file *file, int64_t offset, int whence, int64_t max) {
+    mutex_lock(&file->lock);
+    int64_t base;
+    switch (whence) {
+        case VFS_SEEK_SET: base = 0; break;
+        case VFS_SEEK_CUR: base = file->offset; break;
+        case VFS_SEEK_END: base = file->node->size; break;
+        default:
+            mutex_unlock(&file->lock);
+            return -1;
+    }
+
+    // past the end is fine, the next write leaves a hole
+    int64_t target = base + offset;
+    if (target < 0 || target > max) {
+        mutex_unlock(&file->lock);
+        return -1;
+    }
+
+    file->offset = target;
+    mutex_unlock(&file->lock);
+    return target;
+}
+
+int fd_install(struct task *task, struct vfs_file *file, int first) {
+    for (int fd = first; fd < TASK_MAX_FILES; fd++) {
+        if (!task->files[fd]) {
+            task->files[fd] = file;
+            return fd;
+        }
+    }
+    return -1;
+}
+
+struct vfs_file *fd_get(struct task *task, int fd) {
+    if (fd < 0 || fd >= TASK_MAX_FILES) return nullptr;
+    return task->files[fd];
+}
+
+int fd_close(struct task *task, int fd) {
+    struct vfs_file *file = fd_get(task, fd);
+    if (!file) return -1;
+
+    task->files[fd] = nullptr;
+    vfs_file_put(file);
+    return 0;
+}
+
+void fd_close_all(struct task *task) {
+    for (int fd = 0; fd < TASK_MAX_FILES; fd++) {
+        if (task->files[fd]) fd_close(task, fd);
+    }
+}
@@ -0,0 +1,116 @@
+#include <proc/initramfs.h>
+#include <proc/ramfs.h>
+#include <string.h>
+#include <kprintf>
+
+static const uint8_t *initramfs_archive = nullptr;
+static size_t initramfs_size = 0;
+
+void initramfs_set_module(const void *archive, size_t size) {
+    initramfs_archive = archive;
+    initramfs_size = size;
+}
+
+static uint32_t parse_octal(const char *field, size_t length) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < length && field[i] >= '0' && field[i] <= '7'; i++) {
+        value = value * 8 + (field[i] - '0');
+    }
+    return value;
+}
+
+// The checksum field itself is summed as if it were all spaces
+static bool checksum_ok(const ustar_header_t *header) {
+    const uint8_t *bytes = (const uint8_t *)header;
+    uint32_t sum = 0;
+    for (size_t i = 0; i < USTAR_BLOCK_SIZE; i++) {
+        bool in_field = i >= offsetof(ustar_header_t, checksum) && i < offsetof(ustar_header_t, checksum) + sizeof(header->checksum);
+        sum += in_field ? ' ' : bytes[i];
+    }
+    return sum == parse_octal(header->checksum, sizeof(header->checksum));
+}
+
+// prefix/name, `path` has room for both fields filled up to the last byte
+static void entry_path(const ustar_header_t *header, char *path) {
+    path[0] = '\0';
+    if (header->prefix[0]) {
+        strncat(path, header->prefix, sizeof(header->prefix));
+        strcat(path, "/");
+    }
+    strncat(path, header->name, sizeof(header->name));
+}
+
+// Walks `path` from `root`, making the directories that don't exist yet. With `file` the last component
+// becomes a new file instead, an existing node of that name is left alone and nullptr returned.
+static struct vfs_node *make_path(struct vfs_node *root, const char *path, bool file) {
+    struct vfs_node *current = root;
+    char name[USTAR_PATH_MAX];
+
+    while (*path) {
+        while (*path == '/' || (path[0] == '.' && (path[1] == '/' || path[1] == '\0'))) path++;
+        if (!*path) break;
+
+        size_t length = 0;
+        while (path[length] && path[length] != '/') length++;
+        memcpy(name, path, length);
+        name[length] = '\0';
+        path += length;
+
+        bool last = *path == '\0' || (path[0] == '/' && path[1] == '\0');
+        struct vfs_node *next = vfs_search_node(current, name);
+        if (!next) {
+            next = vfs_create_node(name, (last && file) ? VFS_RAMFS_FILE : VFS_RAMFS_FOLDER, current);
+        } else if (last && file) {
+            return nullptr;
+        }
+        if (!next || (!last && next->type != VFS_RAMFS_FOLDER)) return nullptr;
+        current = next;
+    }
+    return current;
+}
+
+int initramfs_unpack(struct vfs_node *root) {
+    if (!initramfs_archive) {
+        kprintf("initramfs: no %s module\n", INITRAMFS_MODULE_NAME);
+        return -1;
+    }
+
+    int files = 0;
+    char path[USTAR_PATH_MAX];
+    size_t offset = 0;
+    while (offset + USTAR_BLOCK_SIZE <= initramfs_size) {
+        const ustar_header_t *header = (const ustar_header_t *)(initramfs_archive + offset);
+        // the archive ends with two zero blocks, the first one is enough for us
+        if (header->name[0] == '\0') break;
+        if (memcmp(header->magic, "ustar", 5) != 0 || !checksum_ok(header)) {
+            kprintf("initramfs: bad header at offset %lu\n", offset);
+            break;
+        }
+
+        uint32_t size = parse_octal(header->size, sizeof(header->size));
+        const uint8_t *data = initramfs_archive + offset + USTAR_BLOCK_SIZE;
+        if (size > initramfs_size - offset - USTAR_BLOCK_SIZE) {
+            kprintf("initramfs: truncated archive\n");
+            break;
+        }
+
+        entry_path(header, path);
+        if (header->type == USTAR_TYPE_DIRECTORY) {
+            make_path(root, path, false);
+        } else if (header->type == USTAR_TYPE_FILE || header->type == USTAR_TYPE_FILE_OLD) {
+            struct vfs_node *node = make_path(root, path, true);
+            // the archive is never freed, so the file can keep reading out of it
+            if (node && ramfs_attach(node, data, size) == VFS_SUCCESS) {
+                files++;
+            } else {
+                kprintf("initramfs: cannot create %s\n", path);
+            }
+        }
+        // links, devices and fifos have nothing to map onto in ramfs
+
+        offset += USTAR_BLOCK_SIZE + USTAR_ROUND_UP(size);
+    }
+
+    kprintf("initramfs: %d files from a %lu byte archive\n", files, initramfs_size);
+    return files;
+}
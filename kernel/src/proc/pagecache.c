@@ -0,0 +1,343 @@
+#include <proc/pagecache.h>
+#include <proc/spinlock.h>
+#include <proc/sched.h>
+#include <sys/mm/pmm.h>
+#include <sys/mm/vmm.h>
+#include <kheap.h>
+#include <string.h>
+#include <kprintf>
+#include <io.h>
+
+// Guards the index, the LRU list, pins and dirty flags. Never held across I/O, allocation or a copy to a caller's
+// buffer, those run on pinned pages.
+static spinlock_t pagecache_lock = SPINLOCK_INIT;
+// pagecache_invalidate waits here for the pages it can't drop yet
+static struct wait_queue pagecache_waiters;
+static struct cached_page *buckets[PAGECACHE_BUCKETS];
+static struct lru_list lru;
+// Descriptors of evicted pages. The shrinker runs inside pmm_alloc, possibly under the heap lock, so it can't kfree.
+static struct cached_page *spare;
+static uint32_t page_count;
+static uint32_t dirty_count;
+static uint32_t page_limit;
+
+static uint32_t pagecache_hash(struct vfs_node *node, uint32_t index) {
+    return lru_hash(node, index, PAGECACHE_BUCKETS);
+}
+
+static struct cached_page *lookup(struct vfs_node *node, uint32_t index) {
+    for (struct cached_page *page = buckets[pagecache_hash(node, index)]; page; page = page->hash_next) {
+        if (page->node == node && page->index == index) return page;
+    }
+    return nullptr;
+}
+
+// Drops an unpinned page with the lock held, dirty data is lost
+static void evict(struct cached_page *page) {
+    struct cached_page **indirect = &buckets[pagecache_hash(page->node, page->index)];
+    while (*indirect != page) indirect = &(*indirect)->hash_next;
+    *indirect = page->hash_next;
+    lru_unlink(&lru, &page->lru);
+
+    if (page->dirty) dirty_count--;
+    pmm_free(page->data - higher_half_base);
+    page_count--;
+
+    page->node = nullptr;
+    page->data = nullptr;
+    page->dirty = false;
+    page->hash_next = spare;
+    spare = page;
+}
+
+// With the lock held
+static void unpin(struct cached_page *page) {
+    if (--page->pins == 0) sched_wake_all(&pagecache_waiters);
+}
+
+static struct cached_page *lru_victim() {
+    for (struct lru_link *link = lru.tail; link; link = link->prev) {
+        struct cached_page *page = lru_entry(link, struct cached_page, lru);
+        if (!page->pins) return page;
+    }
+    return nullptr;
+}
+
+// Stores the page through the node's writepage, the caller holds a pin. The flag is cleared first so a write
+// landing while the I/O runs dirties the page again instead of getting lost.
+static bool write_page(struct cached_page *page) {
+    struct vfs_node *node = page->node;
+    uint32_t flags = spin_lock_irqsave(&pagecache_lock);
+    bool dirty = page->dirty;
+    if (dirty) {
+        page->dirty = false;
+        dirty_count--;
+    }
+    spin_unlock_irqrestore(&pagecache_lock, flags);
+    if (!dirty) return true;
+
+    // only the part below the end of the file is real, a truncated tail has nothing to store
+    vfs_off_t start = (vfs_off_t)page->index * PAGECACHE_PAGE_SIZE;
+    uint32_t length = node->size <= start ? 0 : node->size - start < PAGECACHE_PAGE_SIZE ? node->size - start : PAGECACHE_PAGE_SIZE;
+    if (length == 0 || node->writepage(node, page->index, page->data, length) == VFS_SUCCESS) return true;
+
+    flags = spin_lock_irqsave(&pagecache_lock);
+    if (!page->dirty) {
+        page->dirty = true;
+        dirty_count++;
+    }
+    spin_unlock_irqrestore(&pagecache_lock, flags);
+    return false;
+}
+
+// Evicts from the cold end until there is room for one more page, dirty pages are written back on the way
+static void make_room() {
+    for (;;) {
+        uint32_t flags = spin_lock_irqsave(&pagecache_lock);
+        struct cached_page *victim = page_count >= page_limit ? lru_victim() : nullptr;
+        if (!victim) {
+            // under the limit, or everything is pinned and the cache grows past it for a moment
+            spin_unlock_irqrestore(&pagecache_lock, flags);
+            return;
+        }
+        if (!victim->dirty) {
+            evict(victim);
+            spin_unlock_irqrestore(&pagecache_lock, flags);
+            continue;
+        }
+
+        victim->pins++;
+        spin_unlock_irqrestore(&pagecache_lock, flags);
+        bool written = write_page(victim);
+
+        flags = spin_lock_irqsave(&pagecache_lock);
+        unpin(victim);
+        // a page the filesystem won't take is kept, moving it to the hot end stops us from retrying it forever
+        if (!written) lru_touch(&lru, &victim->lru);
+        spin_unlock_irqrestore(&pagecache_lock, flags);
+        if (!written) return;
+    }
+}
+
+// Returns the page pinned. `fill` reads it in on a miss, otherwise a missing page starts out as zeros.
+static struct cached_page *get_page(struct vfs_node *node, uint32_t index, bool fill) {
+    uint32_t flags = spin_lock_irqsave(&pagecache_lock);
+    struct cached_page *page = lookup(node, index);
+    if (page) {
+        page->pins++;
+        lru_touch(&lru, &page->lru);
+        spin_unlock_irqrestore(&pagecache_lock, flags);
+        return page;
+    }
+    spin_unlock_irqrestore(&pagecache_lock, flags);
+
+    make_room();
+    void *frame = pmm_alloc();
+    if (!frame) return nullptr;
+    uint8_t *data = (uint8_t *)frame + higher_half_base;
+    if (fill) {
+        if (node->readpage(node, index, data) != VFS_SUCCESS) {
+            pmm_free(frame);
+            return nullptr;
+        }
+    } else {
+        memset(data, 0, PAGECACHE_PAGE_SIZE);
+    }
+
+    flags = spin_lock_irqsave(&pagecache_lock);
+    page = spare;
+    if (page) spare = page->hash_next;
+    spin_unlock_irqrestore(&pagecache_lock, flags);
+    if (!page) page = kmalloc(sizeof(struct cached_page));
+    if (!page) {
+        pmm_free(frame);
+        return nullptr;
+    }
+
+    flags = spin_lock_irqsave(&pagecache_lock);
+    struct cached_page *raced = lookup(node, index);
+    if (raced) {
+        // someone else read it in meanwhile, theirs wins
+        raced->pins++;
+        page->hash_next = spare;
+        spare = page;
+        spin_unlock_irqrestore(&pagecache_lock, flags);
+        pmm_free(frame);
+        return raced;
+    }
+
+    page->node = node;
+    page->index = index;
+    page->data = data;
+    page->dirty = false;
+    page->pins = 1;
+    uint32_t bucket = pagecache_hash(node, index);
+    page->hash_next = buckets[bucket];
+    buckets[bucket] = page;
+    lru_push(&lru, &page->lru);
+    page_count++;
+    spin_unlock_irqrestore(&pagecache_lock, flags);
+    return page;
+}
+
+// Unpins, a write marks the page dirty and moves the end of the file up to `end`
+static void put_page(struct cached_page *page, bool written, vfs_off_t end) {
+    uint32_t flags = spin_lock_irqsave(&pagecache_lock);
+    if (written) {
+        if (!page->dirty) {
+            page->dirty = true;
+            dirty_count++;
+        }
+        if (end > page->node->size) page->node->size = end;
+    }
+    unpin(page);
+    spin_unlock_irqrestore(&pagecache_lock, flags);
+}
+
+int64_t pagecache_readv(struct vfs_node *node, vfs_off_t offset, const struct vfs_iovec *iov, uint32_t count) {
+    int64_t done = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t *buffer = iov[i].base;
+        size_t left = iov[i].length;
+        while (left > 0 && offset < node->size) {
+            uint32_t within = offset % PAGECACHE_PAGE_SIZE;
+            size_t length = PAGECACHE_PAGE_SIZE - within < left ? PAGECACHE_PAGE_SIZE - within : left;
+            if (length > node->size - offset) length = node->size - offset;
+
+            struct cached_page *page = get_page(node, offset / PAGECACHE_PAGE_SIZE, true);
+            if (!page) return done ? done : -1;
+            memcpy(buffer, page->data + within, length);
+            put_page(page, false, 0);
+
+            buffer += length;
+            left -= length;
+            offset += length;
+            done += length;
+        }
+        if (left > 0) break;
+    }
+    return done;
+}
+
+int64_t pagecache_writev(struct vfs_node *node, vfs_off_t offset, const struct vfs_iovec *iov, uint32_t count) {
+    if (!node->writepage) return -1;
+    if (node->fixed_size) {
+        vfs_off_t end = offset;
+        for (uint32_t i = 0; i < count; i++) end += iov[i].length;
+        if (end > node->size) return -1;
+    }
+
+    int64_t done = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t *buffer = iov[i].base;
+        size_t left = iov[i].length;
+        while (left > 0) {
+            uint32_t index = offset / PAGECACHE_PAGE_SIZE;
+            uint32_t within = offset % PAGECACHE_PAGE_SIZE;
+            size_t length = PAGECACHE_PAGE_SIZE - within < left ? PAGECACHE_PAGE_SIZE - within : left;
+
+            // a page that is overwritten entirely or lies past the end has nothing worth reading in
+            bool fill = length < PAGECACHE_PAGE_SIZE && (vfs_off_t)index * PAGECACHE_PAGE_SIZE < node->size;
+            struct cached_page *page = get_page(node, index, fill);
+            if (!page) return -1;
+            memcpy(page->data + within, buffer, length);
+            put_page(page, true, offset + length);
+
+            buffer += length;
+            left -= length;
+            offset += length;
+            done += length;
+        }
+    }
+
+    node->modification_time = get_rtc_timestamp();
+    // the count is global, so is the writeback, otherwise other nodes' pages would keep this writer stalled
+    if (dirty_count > PAGECACHE_DIRTY_LIMIT && !pagecache_writeback(nullptr)) return -1;
+    return done;
+}
+
+bool pagecache_writeback(struct vfs_node *node) {
+    for (;;) {
+        struct cached_page *batch[PAGECACHE_WRITEBACK_BATCH];
+        uint32_t count = 0;
+
+        uint32_t flags = spin_lock_irqsave(&pagecache_lock);
+        for (uint32_t bucket = 0; bucket < PAGECACHE_BUCKETS && count < PAGECACHE_WRITEBACK_BATCH; bucket++) {
+            for (struct cached_page *page = buckets[bucket]; page && count < PAGECACHE_WRITEBACK_BATCH; page = page->hash_next) {
+                if (page->dirty && (!node || page->node == node)) {
+                    page->pins++;
+                    batch[count++] = page;
+                }
+            }
+        }
+        spin_unlock_irqrestore(&pagecache_lock, flags);
+        if (count == 0) return true;
+
+        bool ok = true;
+        for (uint32_t i = 0; i < count; i++) {
+            ok = write_page(batch[i]) && ok;
+        }
+
+        flags = spin_lock_irqsave(&pagecache_lock);
+        for (uint32_t i = 0; i < count; i++) {
+            unpin(batch[i]);
+        }
+        spin_unlock_irqrestore(&pagecache_lock, flags);
+
+        // the failed pages are still dirty and would come right back in the next batch
+        if (!ok) return false;
+    }
+}
+
+void pagecache_invalidate(struct vfs_node *node) {
+    uint32_t flags = spin_lock_irqsave(&pagecache_lock);
+    for (;;) {
+        // a pinned page is still being written back by someone who reads the node, it has to outlive them
+        bool pinned = false;
+        for (uint32_t bucket = 0; bucket < PAGECACHE_BUCKETS; bucket++) {
+            struct cached_page *page = buckets[bucket];
+            while (page) {
+                struct cached_page *next = page->hash_next;
+                if (page->node == node) {
+                    if (page->pins) pinned = true;
+                    else evict(page);
+                }
+                page = next;
+            }
+        }
+        if (!pinned) break;
+        sched_sleep_on(&pagecache_waiters, &pagecache_lock);
+    }
+    spin_unlock_irqrestore(&pagecache_lock, flags);
+}
+
+// Runs inside pmm_alloc when physical memory is gone, so only clean pages are given up and nothing may block
+static size_t pagecache_shrink(size_t wanted) {
+    uint32_t flags = irq_save();
+    if (!spin_trylock(&pagecache_lock)) {
+        irq_restore(flags);
+        return 0;
+    }
+
+    size_t freed = 0;
+    struct lru_link *link = lru.tail;
+    while (link && freed < wanted) {
+        struct lru_link *prev = link->prev;
+        struct cached_page *page = lru_entry(link, struct cached_page, lru);
+        if (!page->pins && !page->dirty) {
+            evict(page);
+            freed++;
+        }
+        link = prev;
+    }
+
+    spin_unlock(&pagecache_lock);
+    irq_restore(flags);
+    return freed;
+}
+
+void pagecache_init() {
+    page_limit = total_pages / PAGECACHE_MAX_SHARE;
+    pmm_register_shrinker(pagecache_shrink);
+    kprintf("pagecache: up to %lu pages\n", page_limit);
+}
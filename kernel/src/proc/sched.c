@@ -2,133 +2,569 @@
 #include <proc/task.h>
 #include <stdbool.h>
 #include <kheap.h>
-#include <sys/pic.h>
+#include <sys/apic.h>
+#include <sys/smp.h>
+#include <proc/sched_trace.h>
 #include <kprintf>
 #include <io.h>
 #include <string.h>
 
-struct task *current_task = nullptr;
+// Every live task is on task_list, ready ones are also queued on one CPU's run queue
+static spinlock_t tasklist_lock = SPINLOCK_INIT;
 static struct task *task_list = nullptr;
+static struct task *zombie_list = nullptr;     // terminated tasks the reaper hasn't freed yet
+static struct task *reaper_task = nullptr;
 
-int last_pid = 0;
+// Tasks in sched_sleep, earliest wake_tsc first
+static spinlock_t sleep_lock = SPINLOCK_INIT;
+static struct task *sleep_list = nullptr;
+
+static int last_pid = 0;
 int get_pid() {
-    last_pid++;
-    return last_pid;
+    return __atomic_add_fetch(&last_pid, 1, __ATOMIC_RELAXED);
+}
+
+struct task *sched_current() {
+    uint32_t flags = irq_save();
+    struct task *task = this_cpu()->current;
+    irq_restore(flags);
+    return task;
+}
+
+// Highest priority first, a class only runs when every class before it has nothing queued
+static const struct sched_class *const sched_classes[] = {
+    [SCHED_DEADLINE] = &dl_sched_class,
+    [SCHED_FIFO] = &rt_sched_class,
+    [SCHED_FAIR] = &fair_sched_class,
+    [SCHED_RR] = &rr_sched_class,
+};
+#define SCHED_CLASS_COUNT (sizeof(sched_classes) / sizeof(sched_classes[0]))
+
+static uint32_t class_index(struct task *task) {
+    return task->policy;
+}
+
+static const struct sched_class *class_of(struct task *task) {
+    return sched_classes[class_index(task)];
+}
+
+void sched_set_policy(struct task *task, enum sched_policy policy) {
+    task->policy = policy;
+}
+
+void sched_set_fifo(struct task *task, uint32_t rt_priority) {
+    task->policy = SCHED_FIFO;
+    task->rt_priority = rt_priority;
+}
+
+uint64_t sched_us_to_cycles(uint64_t us) {
+    // without a calibrated TSC assume 1GHz, admission only looks at the ratio and sleeps just run long or short
+    return tsc_frequency ? us * tsc_frequency / 1000000 : us * 1000;
+}
+
+bool sched_set_deadline(struct task *task, uint32_t runtime_us, uint32_t period_us) {
+    if (runtime_us == 0 || period_us == 0 || runtime_us > period_us) return false;
+    uint32_t bandwidth = (uint64_t)runtime_us * SCHED_DL_UNIT / period_us;
+    uint32_t limit = SCHED_DL_UNIT * SCHED_DL_UTIL_LIMIT / 100;
+
+    // admit on the CPU with the most bandwidth left, the task stays there
+    struct cpu *target = nullptr;
+    for (uint32_t i = 0; i < cpu_count; i++) {
+        if (cpus[i].online && (!target || cpus[i].rq.dl_bandwidth < target->rq.dl_bandwidth)) target = &cpus[i];
+    }
+
+    uint32_t flags = spin_lock_irqsave(&target->rq.lock);
+    bool admitted = target->rq.dl_bandwidth + bandwidth <= limit;
+    if (admitted) {
+        target->rq.dl_bandwidth += bandwidth;
+        task->cpu = target->id;
+        task->policy = SCHED_DEADLINE;
+        task->dl_runtime = sched_us_to_cycles(runtime_us);
+        task->dl_period = sched_us_to_cycles(period_us);
+    }
+    spin_unlock_irqrestore(&target->rq.lock, flags);
+
+    if (!admitted) {
+        kprintf("sched: deadline task %lu rejected, cpu %lu is at %lu/%lu\n", task->pid, target->id, target->rq.dl_bandwidth, limit);
+    }
+    return admitted;
+}
+
+static void release_bandwidth(struct task *task) {
+    struct cpu *cpu = &cpus[task->cpu];
+    spin_lock(&cpu->rq.lock);
+    cpu->rq.dl_bandwidth -= (uint64_t)task->dl_runtime * SCHED_DL_UNIT / task->dl_period;
+    spin_unlock(&cpu->rq.lock);
+}
+
+static void resched_cpu(struct cpu *cpu) {
+    // without a local APIC the next tick has to do
+    if (!lapic) return;
+    lapic_send_ipi(cpu->apic_id, LAPIC_ICR_FIXED | LAPIC_ICR_ASSERT | SCHED_IPI_VECTOR);
+}
+
+// `task` was just queued on `cpu`, kick the CPU if it should run before the current task
+static void check_preempt_wakeup(struct cpu *cpu, struct task *task) {
+    struct task *curr = cpu->current;
+    if (!curr) return;
+
+    bool preempt = curr == cpu->idle || class_index(task) < class_index(curr) ||
+                   (class_index(task) == class_index(curr) && class_of(task)->wakeup_preempt(task, curr));
+    if (preempt) resched_cpu(cpu);
+}
+
+static uint32_t cpu_load(struct cpu *cpu) {
+    return cpu->rq.nr_queued + (cpu->current && cpu->current != cpu->idle);
 }
 
 void sched_add_task(struct task *new_task) {
-    cli();
+    uint32_t flags = spin_lock_irqsave(&tasklist_lock);
     new_task->next = task_list;
     task_list = new_task;
-    sti();
+    spin_unlock(&tasklist_lock);
+
+    // deadline tasks already have the CPU they were admitted on
+    struct cpu *target = &cpus[0];
+    if (new_task->policy == SCHED_DEADLINE) {
+        target = &cpus[new_task->cpu];
+    } else {
+        for (uint32_t i = 1; i < cpu_count; i++) {
+            if (cpus[i].online && cpu_load(&cpus[i]) < cpu_load(target)) target = &cpus[i];
+        }
+    }
+
+    spin_lock(&target->rq.lock);
+    new_task->cpu = target->id;
+    class_of(new_task)->enqueue(&target->rq, new_task, ENQUEUE_NEW);
+    check_preempt_wakeup(target, new_task);
+    spin_unlock_irqrestore(&target->rq.lock, flags);
 }
 
-void sched_remove_task(uint32_t pid) {
-    struct task **indirect = &task_list;
-    while (*indirect && (*indirect)->pid != pid) {
+static void unlink_task(struct task **list, struct task *task) {
+    struct task **indirect = list;
+    while (*indirect && *indirect != task) {
         indirect = &(*indirect)->next;
     }
     if (*indirect) {
-        struct task *removed = *indirect;
-        *indirect = removed->next;
-        kfree(removed);
+        *indirect = task->next;
+    }
+}
+
+static struct task *find_task(uint32_t pid) {
+    for (struct task *task = task_list; task; task = task->next) {
+        if (task->pid == pid) return task;
+    }
+    return nullptr;
+}
+
+void sched_block() {
+    // callers check their wakeup condition with interrupts disabled and only then block,
+    // otherwise a sched_wake from an IRQ could slip in between and be lost
+    current_task->state = TASK_BLOCKED;
+    yield();
+}
+
+void sched_wake(struct task *task) {
+    if (!task) return;
+
+    // a blocked task can't be stolen, so its CPU is stable until we put it back on a queue
+    struct cpu *cpu = &cpus[task->cpu];
+    uint32_t flags = spin_lock_irqsave(&cpu->rq.lock);
+    if (task->state == TASK_BLOCKED || task->state == TASK_WAITING) {
+        task->ready_tsc = rdtsc();
+        task->state = TASK_READY;
+        task->wakeups++;
+        // a task woken before its CPU switched away from it is still current, the switch queues it
+        if (cpu->current != task) {
+            class_of(task)->enqueue(&cpu->rq, task, ENQUEUE_WAKEUP);
+            check_preempt_wakeup(cpu, task);
+        }
+        sched_trace(TRACE_WAKEUP, task->pid, this_cpu()->id);
+    }
+    spin_unlock_irqrestore(&cpu->rq.lock, flags);
+}
+
+void sched_sleep(uint32_t ms) {
+    struct task *self = current_task;
+    uint32_t flags = spin_lock_irqsave(&sleep_lock);
+    self->wake_tsc = rdtsc() + sched_us_to_cycles((uint64_t)ms * 1000);
+
+    struct task **indirect = &sleep_list;
+    while (*indirect && (*indirect)->wake_tsc <= self->wake_tsc) {
+        indirect = &(*indirect)->wait_next;
+    }
+    self->wait_next = *indirect;
+    *indirect = self;
+
+    self->state = TASK_BLOCKED;
+    spin_unlock(&sleep_lock);
+    yield();
+    irq_restore(flags);
+}
+
+// Runs on every switch, whichever CPU gets the lock first wakes everyone whose time is up
+static void wake_sleepers(uint64_t now) {
+    if (!sleep_list || sleep_list->wake_tsc > now) return;
+    if (!spin_trylock(&sleep_lock)) return;
+
+    while (sleep_list && sleep_list->wake_tsc <= now) {
+        struct task *task = sleep_list;
+        sleep_list = task->wait_next;
+        task->wait_next = nullptr;
+        sched_wake(task);
+    }
+    spin_unlock(&sleep_lock);
+}
+
+void sched_sleep_on(struct wait_queue *queue, spinlock_t *lock) {
+    struct task *self = current_task;
+    struct task **tail = &queue->head;
+    while (*tail) tail = &(*tail)->wait_next;
+    self->wait_next = nullptr;
+    *tail = self;
+
+    // a wakeup from another CPU between the unlock and the yield just leaves us READY, on_cpu
+    // keeps everyone else from picking the task up before we are off its stack
+    self->state = TASK_BLOCKED;
+    spin_unlock(lock);
+    yield();
+    spin_lock(lock);
+}
+
+void sched_wake_one(struct wait_queue *queue) {
+    struct task *task = queue->head;
+    if (task) {
+        queue->head = task->wait_next;
+        task->wait_next = nullptr;
+        sched_wake(task);
+    }
+}
+
+void sched_wake_all(struct wait_queue *queue) {
+    while (queue->head) {
+        sched_wake_one(queue);
+    }
+}
+
+void task_exit(int code) {
+    cli();
+    struct task *task = current_task;
+    spin_lock(&tasklist_lock);
+    task->exit_code = code;
+    task->state = TASK_TERMINATED;
+    unlink_task(&task_list, task);
+
+    // orphans are not waited for by anyone, the reaper can take them as soon as they exit
+    for (struct task *child = task_list; child; child = child->next) {
+        if (child->ppid == task->pid) child->ppid = 0;
+    }
+    for (struct task *child = zombie_list; child; child = child->next) {
+        if (child->ppid == task->pid) child->ppid = 0;
     }
-    if (current_task && current_task->pid == pid) {
-        current_task = task_list;
+
+    task->next = zombie_list;
+    zombie_list = task;
+
+    struct task *parent = task->ppid ? find_task(task->ppid) : nullptr;
+    if (parent && parent->state == TASK_WAITING && (parent->wait_pid == 0 || parent->wait_pid == task->pid)) {
+        sched_wake(parent);
+    } else if (!parent) {
+        task->ppid = 0;
     }
+    if (task->ppid == 0) sched_wake(reaper_task);
+    spin_unlock(&tasklist_lock);
+
+    if (task->policy == SCHED_DEADLINE) release_bandwidth(task);
+
+    // the switch takes us off our run queue
     yield();
+    for (;;) hlt();
 }
 
-void schedule() {
-    struct task *next_task = current_task ? current_task->next : task_list;
+int sched_wait(uint32_t pid, int *exit_code) {
+    struct task *self = current_task;
+    uint32_t flags = spin_lock_irqsave(&tasklist_lock);
+
+    for (;;) {
+        for (struct task *zombie = zombie_list; zombie; zombie = zombie->next) {
+            if (zombie->ppid == self->pid && (pid == 0 || zombie->pid == pid)) {
+                int reaped = zombie->pid;
+                if (exit_code) *exit_code = zombie->exit_code;
+                zombie->ppid = 0;
+                sched_wake(reaper_task);
+                spin_unlock_irqrestore(&tasklist_lock, flags);
+                return reaped;
+            }
+        }
+
+        bool has_child = false;
+        for (struct task *child = task_list; child; child = child->next) {
+            if (child->ppid == self->pid && (pid == 0 || child->pid == pid)) {
+                has_child = true;
+                break;
+            }
+        }
+        if (!has_child) {
+            spin_unlock_irqrestore(&tasklist_lock, flags);
+            return -1;
+        }
 
-    if (next_task == nullptr) {
-        next_task = task_list;
+        self->wait_pid = pid;
+        self->state = TASK_WAITING;
+        spin_unlock(&tasklist_lock);
+        yield();
+        spin_lock(&tasklist_lock);
     }
+}
 
-    while (next_task != nullptr && next_task->state != TASK_READY) {
-        next_task = next_task->next;
+static void reaper() {
+    for (;;) {
+        uint32_t flags = spin_lock_irqsave(&tasklist_lock);
+        // detach every task nobody is waiting on in one go and free the batch with interrupts on,
+        // a zombie whose CPU hasn't left its stack yet is picked up on the next round
+        struct task *batch = nullptr;
+        bool busy = false;
+        struct task **indirect = &zombie_list;
+        while (*indirect) {
+            struct task *zombie = *indirect;
+            if (zombie->ppid == 0 && !zombie->on_cpu) {
+                *indirect = zombie->next;
+                zombie->next = batch;
+                batch = zombie;
+            } else {
+                busy |= zombie->ppid == 0;
+                indirect = &zombie->next;
+            }
+        }
 
-        if (next_task == nullptr) {
-            next_task = task_list;
+        if (!batch) {
+            if (!busy) current_task->state = TASK_BLOCKED;
+            spin_unlock(&tasklist_lock);
+            yield();
+            irq_restore(flags);
+            continue;
         }
+        spin_unlock_irqrestore(&tasklist_lock, flags);
 
-        if (next_task == current_task) {
-            break;
+        while (batch) {
+            struct task *next = batch->next;
+            task_destroy(batch);
+            batch = next;
         }
     }
+}
 
-    if (next_task != nullptr && next_task != current_task) {
-        // kprintf("Switching to task %d, EIP: 0x%lx\n", next_task->pid, next_task->eip);
-        current_task = next_task;
-    } else {
-        // kprintf("No task to switch to\n");
+static void idle() {
+    for (;;) {
+        sti();
+        hlt();
     }
 }
 
+static void snapshot_task(struct task_info *info, struct task *task, bool idle) {
+    info->pid = task->pid;
+    info->ppid = task->ppid;
+    info->state = task->state;
+    info->policy = task->policy;
+    info->idle = idle;
+    info->last_cpu = task->last_cpu;
+    info->user_cycles = task->user_cycles;
+    info->kernel_cycles = task->kernel_cycles;
+    info->voluntary_switches = task->voluntary_switches;
+    info->involuntary_switches = task->involuntary_switches;
+    info->wakeups = task->wakeups;
+}
 
-void timer_interrupt_handler(registers_t *regs) {
-    if (current_task) {
-        uintptr_t cr3;
-        __asm__ volatile("mov %%cr3, %0" : "=r"(cr3));
-        current_task->cr3 = (vmm_context_t){ .cr3 = cr3 };
-        current_task->cs = regs->cs; current_task->ds = regs->ds; current_task->es = regs->es; current_task->fs = regs->fs; current_task->gs = regs->gs;
-        if (regs->cs != 0x08) {
-            // coming from usaspac!
-            current_task->ss = regs->ss;
-            current_task->esp = regs->user_esp;
+uint32_t sched_snapshot(struct task_info *out, uint32_t max) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < cpu_count && count < max; i++) {
+        if (cpus[i].idle) snapshot_task(&out[count++], cpus[i].idle, true);
+    }
+
+    uint32_t flags = spin_lock_irqsave(&tasklist_lock);
+    for (struct task *task = task_list; task && count < max; task = task->next) {
+        snapshot_task(&out[count++], task, false);
+    }
+    spin_unlock_irqrestore(&tasklist_lock, flags);
+    return count;
+}
+
+// Takes a runnable task from another CPU's queue, never waits on a contended queue
+static struct task *steal_task(struct cpu *cpu) {
+    for (uint32_t i = 1; i < cpu_count; i++) {
+        struct cpu *victim = &cpus[(cpu->id + i) % cpu_count];
+        if (!victim->online || victim->rq.nr_queued == 0) continue;
+        if (!spin_trylock(&victim->rq.lock)) continue;
+
+        for (uint32_t c = 0; c < SCHED_CLASS_COUNT; c++) {
+            struct task *task = sched_classes[c]->steal(&victim->rq);
+            if (task) {
+                sched_classes[c]->migrate(&victim->rq, &cpu->rq, task);
+                task->cpu = cpu->id;
+                spin_unlock(&victim->rq.lock);
+                return task;
+            }
+        }
+        spin_unlock(&victim->rq.lock);
+    }
+    return nullptr;
+}
+
+// Whether `curr` has to give up the CPU on a tick
+static bool preempt_needed(struct run_queue *rq, struct task *curr) {
+    uint32_t index = class_index(curr);
+    for (uint32_t c = 0; c < index; c++) {
+        if (sched_classes[c]->has_queued(rq)) return true;
+    }
+    return sched_classes[index]->should_preempt(rq, curr);
+}
+
+static struct task *schedule(struct cpu *cpu, struct task *prev, bool voluntary, bool from_user) {
+    struct run_queue *rq = &cpu->rq;
+    uint64_t now = rdtsc();
+    spin_lock(&rq->lock);
+
+    for (uint32_t c = 0; c < SCHED_CLASS_COUNT; c++) {
+        sched_classes[c]->tick(rq, now);
+    }
+
+    // the whole slice since the last charge goes to the mode the tick interrupted
+    if (prev) {
+        uint64_t delta = now - prev->exec_start;
+        if (from_user) prev->user_cycles += delta;
+        else prev->kernel_cycles += delta;
+    }
+
+    // blocked and terminated tasks simply aren't queued again
+    if (prev && prev != cpu->idle) {
+        const struct sched_class *class = class_of(prev);
+        class->update_curr(rq, prev, now - prev->exec_start);
+        prev->exec_start = now;
+
+        if (prev->state == TASK_READY) {
+            if (!voluntary && !preempt_needed(rq, prev)) {
+                spin_unlock(&rq->lock);
+                return prev;
+            }
+            if (voluntary) class->yield(rq, prev);
+            class->enqueue(rq, prev, voluntary ? 0 : ENQUEUE_PREEMPTED);
         }
-        current_task->eflags = regs->eflags;
-        current_task->eip = regs->eip;
-        current_task->kernel_esp = regs->esp;
-        
-        if (current_task->fpu_enabled) {
-            __asm__ volatile("fsave (%0)" : : "r"(&current_task->fpu_state));
+    }
+
+    struct task *next = nullptr;
+    for (uint32_t c = 0; c < SCHED_CLASS_COUNT && !next; c++) {
+        next = sched_classes[c]->pick_next(rq);
+    }
+    if (next == nullptr && cpu_count > 1) {
+        next = steal_task(cpu);
+    }
+    if (next == nullptr) {
+        next = cpu->idle;
+    }
+
+    if (prev && next != prev) {
+        if (voluntary || prev->state != TASK_READY) prev->voluntary_switches++;
+        else prev->involuntary_switches++;
+    }
+
+    next->on_cpu = true;
+    next->exec_start = now;
+    next->last_cpu = cpu->id;
+    cpu->current = next;
+    spin_unlock(&rq->lock);
+    return next;
+}
+
+// Shared by the timer, yield and reschedule IPI vectors, all of them run with interrupts disabled
+static void sched_switch(registers_t *regs, bool voluntary) {
+    struct cpu *cpu = this_cpu();
+    struct task *prev = cpu->current;
+    if (prev) {
+        prev->kernel_esp = (uint32_t)regs;
+
+        if (prev->fpu_enabled) {
+            __asm__ volatile("fsave (%0)" : : "r"(&prev->fpu_state));
         }
-        current_task->registers[0] = regs->eax;
-        current_task->registers[1] = regs->ebx;
-        current_task->registers[2] = regs->ecx;
-        current_task->registers[3] = regs->edx;
-        current_task->registers[4] = regs->esi;
-        current_task->registers[5] = regs->edi;
-        current_task->registers[6] = regs->ebp; 
-
-        current_task->state = TASK_READY;
-    }
-
-    schedule();
-
-    if (current_task) {
-        __asm__ volatile("mov %0, %%cr3" : : "r"(current_task->cr3.cr3));
-        regs->cs = current_task->cs; regs->ds = current_task->ds; regs->es = current_task->es; regs->fs = current_task->fs; regs->gs = current_task->gs;
-        if (current_task->cs != 0x08) {
-            // go to usaspac!
-            regs->ss = current_task->ss;
-            regs->user_esp = current_task->esp;
+        if (prev->state == TASK_RUNNING) {
+            prev->state = TASK_READY;
         }
-        regs->eflags = current_task->eflags;
-        regs->eip = current_task->eip;
-        regs->esp = current_task->kernel_esp;
+    }
+
+    wake_sleepers(rdtsc());
+    struct task *next = schedule(cpu, prev, voluntary, (regs->cs & 3) == 3);
 
-        if (current_task->fpu_enabled) {
-            __asm__ volatile("frstor (%0)" : : "r"(&current_task->fpu_state));
+    if (next != prev) {
+        sched_trace_switch(prev, next);
+        // prev stays pinned to this CPU until isr_common has left its stack
+        if (prev) idt_release_on_exit(&prev->on_cpu);
+        if (!prev || prev->cr3.cr3 != next->cr3.cr3) {
+            __asm__ volatile("mov %0, %%cr3" : : "r"(next->cr3.cr3) : "memory");
         }
-        regs->eax = current_task->registers[0];
-        regs->ebx = current_task->registers[1];
-        regs->ecx = current_task->registers[2];
-        regs->edx = current_task->registers[3];
-        regs->esi = current_task->registers[4];
-        regs->edi = current_task->registers[5];
-        regs->ebp = current_task->registers[6];
+    }
+    if (next->fpu_enabled) {
+        __asm__ volatile("frstor (%0)" : : "r"(&next->fpu_state));
+    }
+
+    // the next interrupt out of ring 3 lands on top of next's kernel stack
+    cpu->tss->esp0 = next->kernel_stack + STACK_SIZE;
+    next->state = TASK_RUNNING;
+    idt_switch_frame((registers_t *)next->kernel_esp);
+}
 
-        current_task->state = TASK_RUNNING;
+// PIT fallback for machines without a usable APIC timer
+void timer_interrupt_handler(registers_t *regs) {
+    // the PIT only interrupts the boot CPU, pass the tick on to the others
+    if (smp_active) {
+        lapic_broadcast_ipi(SCHED_IPI_VECTOR);
+    }
+    sched_switch(regs, false);
+    irq_eoi(0);
+}
+
+static void apic_timer_handler(registers_t *regs) {
+    sched_switch(regs, false);
+    lapic_eoi();
+}
+
+static void yield_handler(registers_t *regs) {
+    sched_switch(regs, true);
+}
+
+static void reschedule_ipi_handler(registers_t *regs) {
+    sched_switch(regs, false);
+    lapic_eoi();
+}
+
+// Every CPU runs this for its own timer, the handlers are shared
+static void sched_start_timer() {
+    idt_register_handler(SCHED_YIELD_VECTOR, yield_handler);
+    idt_register_handler(SCHED_IPI_VECTOR, reschedule_ipi_handler);
+
+    if (lapic_timer_frequency) {
+        idt_register_handler(LAPIC_TIMER_VECTOR, apic_timer_handler);
+        lapic_timer_start(LAPIC_TIMER_VECTOR, SCHED_HZ);
+    } else {
+        idt_register_handler(PIC_REMAP_OFFSET, timer_interrupt_handler);
     }
-    pic_sendeoi(0);
+}
+
+void sched_init_cpu(struct cpu *cpu) {
+    spin_init(&cpu->rq.lock);
+    cpu->idle = task_create((uintptr_t)idle, 0, 0, kernel_page_directory);
+    cpu->idle->cpu = cpu->id;
+    sched_start_timer();
 }
 
 void sched_init(struct task *callback_task) {
-    sti();
+    struct cpu *bsp = &cpus[0];
+    bsp->idle = task_create((uintptr_t)idle, 0, 0, kernel_page_directory);
+
+    reaper_task = task_create((uintptr_t)reaper, 0, 0, kernel_page_directory);
+    sched_add_task(reaper_task);
     sched_add_task(callback_task);
 
-    idt_register_handler(32, timer_interrupt_handler);
-}
\ No newline at end of file
+    // the APIC timers drive preemption on their own, the PIT has nothing left to do
+    if (lapic_timer_frequency) irq_mask(0);
+    sched_start_timer();
+    sti();
+}
@@ -0,0 +1,111 @@
+#include <proc/sched.h>
+#include <proc/sched_class.h>
+#include <io.h>
+
+// How far ahead of the leftmost task the running one may get before a tick preempts it
+static uint64_t granularity() {
+    return tsc_frequency ? tsc_frequency / 1000 * SCHED_FAIR_GRANULARITY_MS : SCHED_FAIR_GRANULARITY_MS * 1000000ull;
+}
+
+static uint64_t weight(struct task *task) {
+    return task->priority ? task->priority : SCHED_NICE_0_WEIGHT;
+}
+
+static bool vruntime_less(const struct rb_node *a, const struct rb_node *b) {
+    return rb_entry(a, struct task, run_node)->vruntime < rb_entry(b, struct task, run_node)->vruntime;
+}
+
+static struct task *leftmost(struct run_queue *rq) {
+    struct rb_node *node = rb_first(&rq->fair_timeline);
+    return node ? rb_entry(node, struct task, run_node) : nullptr;
+}
+
+static void update_min_vruntime(struct run_queue *rq, struct task *curr) {
+    struct task *first = leftmost(rq);
+    uint64_t vruntime = curr->vruntime;
+    if (first && first->vruntime < vruntime) vruntime = first->vruntime;
+    if (vruntime > rq->min_vruntime) rq->min_vruntime = vruntime;
+}
+
+static void fair_enqueue(struct run_queue *rq, struct task *task, int flags) {
+    if (flags & ENQUEUE_NEW) {
+        task->vruntime = rq->min_vruntime;
+    } else if (flags & ENQUEUE_WAKEUP) {
+        // sleeping earns at most one granularity of credit, otherwise a long sleeper would own the CPU
+        uint64_t floor = rq->min_vruntime > granularity() ? rq->min_vruntime - granularity() : 0;
+        if (task->vruntime < floor) task->vruntime = floor;
+    }
+
+    rb_link(&rq->fair_timeline, &task->run_node, vruntime_less);
+    rq->nr_queued++;
+}
+
+static struct task *fair_pick_next(struct run_queue *rq) {
+    struct task *task = leftmost(rq);
+    if (task) {
+        rb_erase(&rq->fair_timeline, &task->run_node);
+        rq->nr_queued--;
+    }
+    return task;
+}
+
+static void fair_update_curr(struct run_queue *rq, struct task *curr, uint64_t delta) {
+    curr->vruntime += delta * SCHED_NICE_0_WEIGHT / weight(curr);
+    update_min_vruntime(rq, curr);
+}
+
+static bool fair_has_queued(struct run_queue *rq) {
+    return rq->fair_timeline.root != nullptr;
+}
+
+static bool fair_should_preempt(struct run_queue *rq, struct task *curr) {
+    struct task *first = leftmost(rq);
+    return first && curr->vruntime > first->vruntime + granularity();
+}
+
+static bool fair_wakeup_preempt(struct task *, struct task *) {
+    return false;
+}
+
+static void fair_tick(struct run_queue *, uint64_t) {
+}
+
+static void fair_yield(struct run_queue *rq, struct task *curr) {
+    // go behind everyone that is queued, a task spinning on yield() must not keep the CPU
+    struct rb_node *node = rb_last(&rq->fair_timeline);
+    if (node) {
+        struct task *last = rb_entry(node, struct task, run_node);
+        if (last->vruntime >= curr->vruntime) curr->vruntime = last->vruntime + 1;
+    }
+}
+
+static struct task *fair_steal(struct run_queue *rq) {
+    for (struct rb_node *node = rb_first(&rq->fair_timeline); node; node = rb_next(node)) {
+        struct task *task = rb_entry(node, struct task, run_node);
+        if (!task->on_cpu) {
+            rb_erase(&rq->fair_timeline, node);
+            rq->nr_queued--;
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+static void fair_migrate(struct run_queue *from, struct run_queue *to, struct task *task) {
+    // keep the lag relative to the queue the task came from, woken tasks sit below min_vruntime so it can be negative
+    int64_t lag = (int64_t)(task->vruntime - from->min_vruntime);
+    task->vruntime = lag < 0 && (uint64_t)-lag > to->min_vruntime ? 0 : to->min_vruntime + lag;
+}
+
+const struct sched_class fair_sched_class = {
+    .enqueue = fair_enqueue,
+    .pick_next = fair_pick_next,
+    .update_curr = fair_update_curr,
+    .has_queued = fair_has_queued,
+    .should_preempt = fair_should_preempt,
+    .wakeup_preempt = fair_wakeup_preempt,
+    .tick = fair_tick,
+    .yield = fair_yield,
+    .steal = fair_steal,
+    .migrate = fair_migrate,
+};
@@ -0,0 +1,73 @@
+#include <proc/sched.h>
+#include <proc/sched_class.h>
+
+static void rr_enqueue(struct run_queue *rq, struct task *task, int) {
+    task->rq_next = nullptr;
+    if (rq->rr_tail) rq->rr_tail->rq_next = task;
+    else rq->rr_head = task;
+    rq->rr_tail = task;
+    rq->nr_queued++;
+}
+
+static void rr_unlink(struct run_queue *rq, struct task *prev, struct task *task) {
+    if (prev) prev->rq_next = task->rq_next;
+    else rq->rr_head = task->rq_next;
+    if (rq->rr_tail == task) rq->rr_tail = prev;
+    task->rq_next = nullptr;
+    rq->nr_queued--;
+}
+
+static struct task *rr_pick_next(struct run_queue *rq) {
+    struct task *task = rq->rr_head;
+    if (task) rr_unlink(rq, nullptr, task);
+    return task;
+}
+
+static void rr_update_curr(struct run_queue *, struct task *, uint64_t) {
+}
+
+static bool rr_has_queued(struct run_queue *rq) {
+    return rq->rr_head != nullptr;
+}
+
+// every tick hands the CPU to the next task in line
+static bool rr_should_preempt(struct run_queue *rq, struct task *) {
+    return rq->rr_head != nullptr;
+}
+
+static bool rr_wakeup_preempt(struct task *, struct task *) {
+    return false;
+}
+
+static void rr_tick(struct run_queue *, uint64_t) {
+}
+
+static void rr_yield(struct run_queue *, struct task *) {
+}
+
+static struct task *rr_steal(struct run_queue *rq) {
+    struct task *prev = nullptr;
+    for (struct task *task = rq->rr_head; task; prev = task, task = task->rq_next) {
+        if (!task->on_cpu) {
+            rr_unlink(rq, prev, task);
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+static void rr_migrate(struct run_queue *, struct run_queue *, struct task *) {
+}
+
+const struct sched_class rr_sched_class = {
+    .enqueue = rr_enqueue,
+    .pick_next = rr_pick_next,
+    .update_curr = rr_update_curr,
+    .has_queued = rr_has_queued,
+    .should_preempt = rr_should_preempt,
+    .wakeup_preempt = rr_wakeup_preempt,
+    .tick = rr_tick,
+    .yield = rr_yield,
+    .steal = rr_steal,
+    .migrate = rr_migrate,
+};
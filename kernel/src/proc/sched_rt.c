@@ -0,0 +1,204 @@
+#include <proc/sched.h>
+#include <proc/sched_class.h>
+#include <io.h>
+
+// FIFO: strict priority, a task keeps the CPU until it blocks, yields or a higher priority one shows up.
+// Throttled as a whole once the CPU's FIFO tasks used up their runtime for the period.
+
+static bool rt_before(const struct rb_node *a, const struct rb_node *b) {
+    return rb_entry(a, struct task, run_node)->rt_priority > rb_entry(b, struct task, run_node)->rt_priority;
+}
+
+// Ties go left, so a preempted task is put back in front of its equals
+static bool rt_before_or_equal(const struct rb_node *a, const struct rb_node *b) {
+    return rb_entry(a, struct task, run_node)->rt_priority >= rb_entry(b, struct task, run_node)->rt_priority;
+}
+
+static struct task *rt_first(struct run_queue *rq) {
+    struct rb_node *node = rb_first(&rq->rt_queue);
+    return node ? rb_entry(node, struct task, run_node) : nullptr;
+}
+
+static void rt_enqueue(struct run_queue *rq, struct task *task, int flags) {
+    rb_link(&rq->rt_queue, &task->run_node, (flags & ENQUEUE_PREEMPTED) ? rt_before_or_equal : rt_before);
+    rq->nr_queued++;
+}
+
+static struct task *rt_pick_next(struct run_queue *rq) {
+    if (rq->rt_throttled) return nullptr;
+    struct task *task = rt_first(rq);
+    if (task) {
+        rb_erase(&rq->rt_queue, &task->run_node);
+        rq->nr_queued--;
+    }
+    return task;
+}
+
+static void rt_update_curr(struct run_queue *rq, struct task *, uint64_t delta) {
+    rq->rt_time += delta;
+    if (rq->rt_time >= sched_us_to_cycles(SCHED_RT_RUNTIME_US)) rq->rt_throttled = true;
+}
+
+static bool rt_has_queued(struct run_queue *rq) {
+    return !rq->rt_throttled && rq->rt_queue.root != nullptr;
+}
+
+static bool rt_should_preempt(struct run_queue *rq, struct task *curr) {
+    struct task *first = rt_first(rq);
+    return rq->rt_throttled || (first && first->rt_priority > curr->rt_priority);
+}
+
+static bool rt_wakeup_preempt(struct task *task, struct task *curr) {
+    return task->rt_priority > curr->rt_priority;
+}
+
+// Starts a new period, and with it lifts the throttle, once the last one is over
+static void rt_tick(struct run_queue *rq, uint64_t now) {
+    if (now - rq->rt_period_start < sched_us_to_cycles(SCHED_RT_PERIOD_US)) return;
+    rq->rt_period_start = now;
+    rq->rt_time = 0;
+    rq->rt_throttled = false;
+}
+
+static void rt_yield(struct run_queue *, struct task *) {
+    // enqueueing without ENQUEUE_PREEMPTED already puts it behind its equals
+}
+
+static struct task *rt_steal(struct run_queue *rq) {
+    for (struct rb_node *node = rb_first(&rq->rt_queue); node; node = rb_next(node)) {
+        struct task *task = rb_entry(node, struct task, run_node);
+        if (!task->on_cpu) {
+            rb_erase(&rq->rt_queue, node);
+            rq->nr_queued--;
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+static void rt_migrate(struct run_queue *, struct run_queue *, struct task *) {
+}
+
+const struct sched_class rt_sched_class = {
+    .enqueue = rt_enqueue,
+    .pick_next = rt_pick_next,
+    .update_curr = rt_update_curr,
+    .has_queued = rt_has_queued,
+    .should_preempt = rt_should_preempt,
+    .wakeup_preempt = rt_wakeup_preempt,
+    .tick = rt_tick,
+    .yield = rt_yield,
+    .steal = rt_steal,
+    .migrate = rt_migrate,
+};
+
+// Deadline: earliest deadline first on the CPU the task was admitted to. A task that runs out of
+// budget is throttled until its period ends, so an admitted set can't starve the classes below.
+
+static bool dl_before(const struct rb_node *a, const struct rb_node *b) {
+    return rb_entry(a, struct task, run_node)->dl_deadline < rb_entry(b, struct task, run_node)->dl_deadline;
+}
+
+static struct task *dl_first(struct run_queue *rq) {
+    struct rb_node *node = rb_first(&rq->dl_timeline);
+    return node ? rb_entry(node, struct task, run_node) : nullptr;
+}
+
+static void dl_replenish(struct task *task, uint64_t now) {
+    while (task->dl_deadline <= now) {
+        task->dl_deadline += task->dl_period;
+    }
+    task->dl_budget = task->dl_runtime;
+    task->dl_throttled = false;
+}
+
+static void dl_enqueue(struct run_queue *rq, struct task *task, int flags) {
+    uint64_t now = rdtsc();
+    if (flags & ENQUEUE_NEW) {
+        task->dl_deadline = now + task->dl_period;
+        task->dl_budget = task->dl_runtime;
+        task->dl_throttled = false;
+    } else if (now >= task->dl_deadline) {
+        // woke up after its deadline passed, start a fresh period
+        task->dl_deadline = now;
+        dl_replenish(task, now);
+    }
+
+    if (task->dl_throttled) {
+        task->rq_next = rq->dl_throttled;
+        rq->dl_throttled = task;
+    } else {
+        rb_link(&rq->dl_timeline, &task->run_node, dl_before);
+    }
+    rq->nr_queued++;
+}
+
+static struct task *dl_pick_next(struct run_queue *rq) {
+    struct task *task = dl_first(rq);
+    if (task) {
+        rb_erase(&rq->dl_timeline, &task->run_node);
+        rq->nr_queued--;
+    }
+    return task;
+}
+
+static void dl_update_curr(struct run_queue *, struct task *curr, uint64_t delta) {
+    curr->dl_budget -= (int64_t)delta;
+    if (curr->dl_budget <= 0) curr->dl_throttled = true;
+}
+
+static bool dl_has_queued(struct run_queue *rq) {
+    return rq->dl_timeline.root != nullptr;
+}
+
+static bool dl_should_preempt(struct run_queue *rq, struct task *curr) {
+    struct task *first = dl_first(rq);
+    return curr->dl_throttled || (first && first->dl_deadline < curr->dl_deadline);
+}
+
+static bool dl_wakeup_preempt(struct task *task, struct task *curr) {
+    return task->dl_deadline < curr->dl_deadline;
+}
+
+// Moves throttled tasks whose period is over back onto the timeline
+static void dl_tick(struct run_queue *rq, uint64_t now) {
+    struct task **indirect = &rq->dl_throttled;
+    while (*indirect) {
+        struct task *task = *indirect;
+        if (now >= task->dl_deadline) {
+            *indirect = task->rq_next;
+            task->rq_next = nullptr;
+            dl_replenish(task, now);
+            rb_link(&rq->dl_timeline, &task->run_node, dl_before);
+        } else {
+            indirect = &task->rq_next;
+        }
+    }
+}
+
+static void dl_yield(struct run_queue *, struct task *curr) {
+    // done for this period, the rest of the budget is given up
+    curr->dl_budget = 0;
+    curr->dl_throttled = true;
+}
+
+// Deadline tasks stay on the CPU whose bandwidth they were admitted against
+static struct task *dl_steal(struct run_queue *) {
+    return nullptr;
+}
+
+static void dl_migrate(struct run_queue *, struct run_queue *, struct task *) {
+}
+
+const struct sched_class dl_sched_class = {
+    .enqueue = dl_enqueue,
+    .pick_next = dl_pick_next,
+    .update_curr = dl_update_curr,
+    .has_queued = dl_has_queued,
+    .should_preempt = dl_should_preempt,
+    .wakeup_preempt = dl_wakeup_preempt,
+    .tick = dl_tick,
+    .yield = dl_yield,
+    .steal = dl_steal,
+    .migrate = dl_migrate,
+};
@@ -0,0 +1,134 @@
+#include <proc/sched_trace.h>
+#include <proc/sched.h>
+#include <sys/smp.h>
+#include <kprintf>
+#include <string.h>
+#include <io.h>
+
+struct trace_ring {
+    volatile uint32_t head;             // Total events written, the slot is head % SCHED_TRACE_EVENTS
+    volatile uint32_t start;            // head at the last sched_trace_clear, older events aren't dumped
+    struct sched_trace_event events[SCHED_TRACE_EVENTS];
+};
+
+struct trace_histograms {
+    uint32_t wait[SCHED_TRACE_BUCKETS];     // READY until switched in
+    uint32_t slice[SCHED_TRACE_BUCKETS];    // switched in until switched out
+};
+
+bool sched_trace_enabled = true;
+
+static struct trace_ring rings[MAX_CPUS];
+static struct trace_histograms histograms[MAX_CPUS];
+
+static const char *const type_names[] = {
+    "switch-in", "switch-out", "wakeup", "block", "irq-entry", "irq-exit"
+};
+
+static void record(struct cpu *cpu, enum sched_trace_type type, uint32_t pid, uint16_t arg, uint64_t tsc) {
+    struct trace_ring *ring = &rings[cpu->id];
+    uint32_t head = ring->head;
+    struct sched_trace_event *event = &ring->events[head % SCHED_TRACE_EVENTS];
+    event->tsc = tsc;
+    event->pid = pid;
+    event->arg = arg;
+    event->type = type;
+    event->cpu = cpu->id;
+    // publish only after the slot is complete so readers can tell which slots are stable
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void sched_trace(enum sched_trace_type type, uint32_t pid, uint16_t arg) {
+    if (!sched_trace_enabled) return;
+    uint32_t flags = irq_save();
+    record(this_cpu(), type, pid, arg, rdtsc());
+    irq_restore(flags);
+}
+
+static uint32_t bucket(uint64_t cycles) {
+    uint32_t b = 0;
+    while (cycles >>= 1) b++;
+    return b < SCHED_TRACE_BUCKETS ? b : SCHED_TRACE_BUCKETS - 1;
+}
+
+void sched_trace_switch(struct task *prev, struct task *next) {
+    uint64_t now = rdtsc();
+    struct cpu *cpu = this_cpu();
+
+    if (prev) {
+        if (sched_trace_enabled) {
+            if (prev->state == TASK_BLOCKED || prev->state == TASK_WAITING) {
+                record(cpu, TRACE_BLOCK, prev->pid, prev->state, now);
+            }
+            record(cpu, TRACE_SWITCH_OUT, prev->pid, prev->state, now);
+        }
+        if (prev != cpu->idle) histograms[cpu->id].slice[bucket(now - prev->run_start_tsc)]++;
+        if (prev->state == TASK_READY) prev->ready_tsc = now;
+    }
+
+    if (sched_trace_enabled) record(cpu, TRACE_SWITCH_IN, next->pid, prev ? prev->pid : 0, now);
+    if (next != cpu->idle) histograms[cpu->id].wait[bucket(now - next->ready_tsc)]++;
+    next->run_start_tsc = now;
+}
+
+void sched_trace_clear() {
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        memset(&histograms[i], 0, sizeof(struct trace_histograms));
+        // the writer never looks at start, moving it up hides everything recorded so far
+        __atomic_store_n(&rings[i].start, __atomic_load_n(&rings[i].head, __ATOMIC_ACQUIRE), __ATOMIC_RELAXED);
+    }
+}
+
+void sched_trace_dump(void (*out)(const char *line, void *arg), void *arg) {
+    char line[96];
+    for (uint32_t cpu = 0; cpu < cpu_count; cpu++) {
+        struct trace_ring *ring = &rings[cpu];
+        // start first, it is an older head and can't end up past the one read after it
+        uint32_t start = __atomic_load_n(&ring->start, __ATOMIC_ACQUIRE);
+        uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (head - start > SCHED_TRACE_EVENTS) start = head - SCHED_TRACE_EVENTS;
+
+        for (uint32_t i = start; i != head; i++) {
+            struct sched_trace_event event = ring->events[i % SCHED_TRACE_EVENTS];
+            // the copy has to be done before head is looked at again. Once the writer got to event
+            // i + SCHED_TRACE_EVENTS it may have been halfway through the slot while we read it.
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&ring->head, __ATOMIC_RELAXED) - i >= SCHED_TRACE_EVENTS) continue;
+
+            ksnprintf(line, sizeof(line), "cpu%u %llu %s pid=%lu arg=%u\n",
+                      event.cpu, event.tsc, type_names[event.type], event.pid, event.arg);
+            out(line, arg);
+        }
+    }
+}
+
+static void print_histogram(const char *title, uint32_t (*select)(uint32_t cpu, uint32_t b),
+                            void (*out)(const char *line, void *arg), void *arg) {
+    char line[96];
+    out(title, arg);
+    for (uint32_t b = 0; b < SCHED_TRACE_BUCKETS; b++) {
+        uint32_t count = 0;
+        for (uint32_t cpu = 0; cpu < cpu_count; cpu++) count += select(cpu, b);
+        if (count == 0) continue;
+
+        if (tsc_frequency) {
+            ksnprintf(line, sizeof(line), "  >= %-10llu ns  %lu\n", (1ull << b) * 1000000000ull / tsc_frequency, count);
+        } else {
+            ksnprintf(line, sizeof(line), "  >= 2^%-2lu cycles  %lu\n", b, count);
+        }
+        out(line, arg);
+    }
+}
+
+static uint32_t select_wait(uint32_t cpu, uint32_t b) {
+    return histograms[cpu].wait[b];
+}
+
+static uint32_t select_slice(uint32_t cpu, uint32_t b) {
+    return histograms[cpu].slice[b];
+}
+
+void sched_trace_histograms(void (*out)(const char *line, void *arg), void *arg) {
+    print_histogram("run queue wait latency\n", select_wait, out, arg);
+    print_histogram("time slice used\n", select_slice, out, arg);
+}
@@ -0,0 +1,110 @@
+#include <proc/task.h>
+#include <proc/sched.h>
+#include <proc/file.h>
+#include <sys/idt.h>
+#include <io.h>
+#include <kheap.h>
+#include <sys/mm/pmm.h>
+#include <string.h>
+
+static void task_return_trampoline() {
+    // callbacks that simply return end up here instead of running off their stack
+    task_exit(0);
+}
+
+static struct task *task_alloc(uint32_t ppid, uint32_t priority, vmm_context_t cr3) {
+    struct task *task = kmalloc(sizeof(struct task));
+    if (!task) return nullptr;
+
+    uint8_t *stack = kmalloc(STACK_SIZE);
+    if (!stack) {
+        kfree(task);
+        return nullptr;
+    }
+
+    memset(task, 0, sizeof(struct task));
+    task->pid = get_pid();
+    task->ppid = ppid;
+    task->priority = priority;
+    task->nieche = priority;
+    task->cr3 = cr3;
+    task->fpu_enabled = false;
+    task->kernel_stack = (uintptr_t)stack;
+    task->state = TASK_READY;
+    task->policy = SCHED_DEFAULT_POLICY;
+    task->ready_tsc = rdtsc();
+    return task;
+}
+
+struct task *task_create_arg(uintptr_t callback, uintptr_t arg, uint32_t ppid, uint32_t priority, vmm_context_t cr3) {
+    struct task *task = task_alloc(ppid, priority, cr3);
+    if (!task) return nullptr;
+    uint8_t *stack = (uint8_t *)task->kernel_stack;
+
+    // Build the frame isr_common will pop when the task is first switched to. Kernel tasks
+    // iret without a privilege change so the frame ends at eflags, user_esp/ss alias the
+    // return address slot and are never touched.
+    uint32_t *sp = (uint32_t *)(stack + STACK_SIZE);
+    *--sp = arg;
+    *--sp = (uint32_t)task_return_trampoline;
+
+    registers_t *frame = (registers_t *)((uintptr_t)sp - offsetof(registers_t, user_esp));
+    memset(frame, 0, offsetof(registers_t, user_esp));
+    frame->gs = frame->fs = 0x00;   // gs, fs are reserved
+    frame->es = frame->ds = 0x10;
+    frame->cs = 0x08;               // all tasks start in kernel mode
+    frame->eip = callback;
+    frame->eflags = 0x202;
+
+    task->kernel_esp = (uint32_t)frame;
+    return task;
+}
+
+struct task *task_create_user(uintptr_t entry, uintptr_t user_esp, uint32_t ppid, uint32_t priority, vmm_context_t cr3) {
+    struct task *task = task_alloc(ppid, priority, cr3);
+    if (!task) return nullptr;
+    task->user = true;
+
+    // The iret out of this frame drops to ring 3, so unlike a kernel task it carries user_esp/ss
+    // and sits right where the CPU pushes the next one: at esp0, the top of the kernel stack.
+    registers_t *frame = (registers_t *)(task->kernel_stack + STACK_SIZE - sizeof(registers_t));
+    memset(frame, 0, sizeof(registers_t));
+    frame->gs = frame->fs = frame->es = frame->ds = GDT_USER_DATA_SELECTOR;
+    frame->cs = GDT_USER_CODE_SELECTOR;
+    frame->ss = GDT_USER_DATA_SELECTOR;
+    frame->eip = entry;
+    frame->user_esp = user_esp;
+    frame->eflags = 0x202;
+
+    task->kernel_esp = (uint32_t)frame;
+    return task;
+}
+
+uintptr_t task_map_user_stack(vmm_context_t *cr3) {
+    for (uintptr_t page = USER_STACK_TOP - USER_STACK_SIZE; page < USER_STACK_TOP; page += PAGE_SIZE) {
+        void *frame = pmm_alloc();
+        if (!frame) return 0;
+        memset((uint8_t *)frame + higher_half_base, 0, PAGE_SIZE);
+        // whatever was mapped so far goes away with the address space
+        if (!vmm_map_page(cr3, page, PAGE_SIZE, (uintptr_t)frame, PAGE_PRESENT | PAGE_RW | PAGE_USER)) {
+            pmm_free(frame);
+            return 0;
+        }
+    }
+    return USER_STACK_TOP;
+}
+
+struct task *task_create(uintptr_t callback, uint32_t ppid, uint32_t priority, vmm_context_t cr3) {
+    return task_create_arg(callback, 0, ppid, priority, cr3);
+}
+
+void task_destroy(struct task *task) {
+    if (task->cr3.pd && task->cr3.pd != kernel_page_directory.pd) {
+        vmm_destroy_pd(&task->cr3);
+    }
+    fd_close_all(task);
+    if (task->image) close(task->image);
+    if (task->segments) kfree(task->segments);
+    kfree((void *)task->kernel_stack);
+    kfree(task);
+}
@@ -0,0 +1,43 @@
+#include <proc/uaccess.h>
+#include <proc/elf.h>
+#include <proc/sched.h>
+#include <sys/mm/vmm.h>
+#include <string.h>
+
+bool user_access_ok(uint32_t address, uint32_t size, bool write) {
+    if (size == 0) return true;
+    if (address + size < address || address + size > higher_half_base) return false;
+
+    struct task *task = current_task;
+    if (!task || !task->user) return false;
+
+    // CR0.WP may be clear, so a read-only page has to be refused here rather than by the MMU
+    uint32_t needed = PAGE_PRESENT | PAGE_USER | (write ? PAGE_RW : 0);
+    for (uint32_t page = ROUND_DOWN_TO_PAGE(address); page < address + size; page += PAGE_SIZE) {
+        if (!vmm_page_flags(&task->cr3, page) && !elf_fault_in(task, page)) return false;
+        if ((vmm_page_flags(&task->cr3, page) & needed) != needed) return false;
+    }
+    return true;
+}
+
+bool copy_from_user(void *dst, uint32_t src, uint32_t size) {
+    if (!user_access_ok(src, size, false)) return false;
+    memcpy(dst, (const void *)src, size);
+    return true;
+}
+
+bool copy_to_user(uint32_t dst, const void *src, uint32_t size) {
+    if (!user_access_ok(dst, size, true)) return false;
+    memcpy((void *)dst, src, size);
+    return true;
+}
+
+bool copy_string_from_user(char *dst, uint32_t src, uint32_t max) {
+    for (uint32_t i = 0; i < max; i++) {
+        // one check per page the string reaches into
+        if ((i == 0 || ((src + i) & ~PAGE_MASK) == 0) && !user_access_ok(src + i, 1, false)) return false;
+        dst[i] = ((const char *)src)[i];
+        if (dst[i] == '\0') return true;
+    }
+    return false;
+}
@@ -1,6 +1,12 @@
 #include <proc/vfs.h>
 #include <proc/ramfs.h>
+#include <proc/dcache.h>
+#include <proc/pagecache.h>
+#include <proc/spinlock.h>
+#include <fs/bcache.h>
 #include <kheap.h>
+#include <sys/mm/pmm.h>
+#include <sys/mm/vmm.h>
 #include <string.h>
 #include <io.h>
 #include <kprintf>
@@ -12,50 +18,214 @@
  * 
  * 
  */
+// Holes in a sparse file read from here
+static const uint8_t ramfs_zero_chunk[RAMFS_CHUNK_SIZE];
+
+static uint8_t *ramfs_alloc_chunk() {
+    void *frame = pmm_alloc();
+    if (!frame) return nullptr;
+    uint8_t *chunk = (uint8_t *)frame + higher_half_base;
+    memset(chunk, 0, RAMFS_CHUNK_SIZE);
+    return chunk;
+}
+
+static void ramfs_free_chunk(uint8_t *chunk) {
+    pmm_free(chunk - higher_half_base);
+}
+
+static void ramfs_free_chunks(struct vfs_ramfs_node *ramfs_node) {
+    for (uint32_t i = 0; i < ramfs_node->chunk_slots; i++) {
+        if (ramfs_node->chunks[i]) ramfs_free_chunk(ramfs_node->chunks[i]);
+    }
+    if (ramfs_node->chunks) kfree(ramfs_node->chunks);
+    ramfs_node->chunks = nullptr;
+    ramfs_node->chunk_slots = 0;
+}
+
+// Grows the chunk index geometrically so appending stays cheap, only the pointers are ever copied
+static bool ramfs_reserve(struct vfs_ramfs_node *ramfs_node, uint32_t slots) {
+    if (slots <= ramfs_node->chunk_slots) return true;
+
+    uint32_t capacity = ramfs_node->chunk_slots ? ramfs_node->chunk_slots * 2 : 8;
+    if (capacity < slots) capacity = slots;
+    uint8_t **chunks = krealloc(ramfs_node->chunks, capacity * sizeof(uint8_t *));
+    if (!chunks) return false;
+
+    memset(chunks + ramfs_node->chunk_slots, 0, (capacity - ramfs_node->chunk_slots) * sizeof(uint8_t *));
+    ramfs_node->chunks = chunks;
+    ramfs_node->chunk_slots = capacity;
+    return true;
+}
+
+static const uint8_t *ramfs_chunk(struct vfs_ramfs_node *ramfs_node, uint32_t offset) {
+    if (ramfs_node->backing) return ramfs_node->backing + offset - offset % RAMFS_CHUNK_SIZE;
+    uint32_t index = offset / RAMFS_CHUNK_SIZE;
+    if (index < ramfs_node->chunk_slots && ramfs_node->chunks[index]) return ramfs_node->chunks[index];
+    return ramfs_zero_chunk;
+}
+
+static vfs_err_t ramfs_store(struct vfs_ramfs_node *ramfs_node, uint32_t offset, uint32_t size, const uint8_t *buffer) {
+    // ramfs offsets are 32 bit, a range ending past that would wrap the slot count
+    if ((uint64_t)offset + size > UINT32_MAX) return VFS_ERROR;
+    if (!ramfs_reserve(ramfs_node, (uint32_t)(((uint64_t)offset + size + RAMFS_CHUNK_SIZE - 1) / RAMFS_CHUNK_SIZE))) return VFS_ERROR;
+
+    while (size > 0) {
+        uint32_t index = offset / RAMFS_CHUNK_SIZE;
+        uint32_t within = offset % RAMFS_CHUNK_SIZE;
+        uint32_t length = RAMFS_CHUNK_SIZE - within < size ? RAMFS_CHUNK_SIZE - within : size;
+
+        if (!ramfs_node->chunks[index]) {
+            ramfs_node->chunks[index] = ramfs_alloc_chunk();
+            if (!ramfs_node->chunks[index]) return VFS_ERROR;
+        }
+        memcpy(ramfs_node->chunks[index] + within, buffer, length);
+        offset += length;
+        buffer += length;
+        size -= length;
+    }
+    return VFS_SUCCESS;
+}
+
+// Zeroes [offset, end), chunks that end up entirely zero are released and become holes again
+static void ramfs_zero(struct vfs_ramfs_node *ramfs_node, uint32_t offset, uint32_t end) {
+    while (offset < end) {
+        uint32_t index = offset / RAMFS_CHUNK_SIZE;
+        uint32_t within = offset % RAMFS_CHUNK_SIZE;
+        uint32_t length = RAMFS_CHUNK_SIZE - within < end - offset ? RAMFS_CHUNK_SIZE - within : end - offset;
+
+        if (index < ramfs_node->chunk_slots && ramfs_node->chunks[index]) {
+            if (length == RAMFS_CHUNK_SIZE) {
+                ramfs_free_chunk(ramfs_node->chunks[index]);
+                ramfs_node->chunks[index] = nullptr;
+            } else {
+                memset(ramfs_node->chunks[index] + within, 0, length);
+            }
+        }
+        offset += length;
+    }
+}
+
+// Copies out of the chunks, the range has been checked against the size already
+static void ramfs_load(struct vfs_ramfs_node *ramfs_node, uint32_t offset, uint32_t size, uint8_t *buffer) {
+    while (size > 0) {
+        uint32_t within = offset % RAMFS_CHUNK_SIZE;
+        uint32_t length = RAMFS_CHUNK_SIZE - within < size ? RAMFS_CHUNK_SIZE - within : size;
+        memcpy(buffer, ramfs_chunk(ramfs_node, offset) + within, length);
+        offset += length;
+        buffer += length;
+        size -= length;
+    }
+}
+
 vfs_err_t ramfs_read(struct vfs_node *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
-    struct vfs_ramfs_node *ramfs_node = (struct vfs_ramfs_node *)node;
     if (node->type != VFS_RAMFS_FILE) return VFS_ERROR;
-    memcpy(buffer, ramfs_node->data + offset, size);
+    if (offset > node->size || size > node->size - offset) return VFS_ERROR;
+
+    ramfs_load((struct vfs_ramfs_node *)node, offset, size, buffer);
     return VFS_SUCCESS;
 }
 
-vfs_err_t ramfs_write(struct vfs_node *node, uint32_t offset, uint32_t size, const uint8_t *buffer) {
+// ramfs files never grow past 4 GiB (see ramfs_writev), so anything below the size fits the chunk index
+int64_t ramfs_readv(struct vfs_node *node, vfs_off_t offset, const struct vfs_iovec *iov, uint32_t count) {
+    if (node->type != VFS_RAMFS_FILE) return -1;
+
+    int64_t done = 0;
+    for (uint32_t i = 0; i < count && offset < node->size; i++) {
+        uint32_t length = iov[i].length < node->size - offset ? iov[i].length : node->size - offset;
+        ramfs_load((struct vfs_ramfs_node *)node, offset, length, iov[i].base);
+        offset += length;
+        done += length;
+    }
+    return done;
+}
+
+// Hands out at most the rest of one chunk, read_direct callers loop
+vfs_err_t ramfs_map(struct vfs_node *node, uint32_t offset, const uint8_t **data, uint32_t *length) {
     struct vfs_ramfs_node *ramfs_node = (struct vfs_ramfs_node *)node;
     if (node->type != VFS_RAMFS_FILE) return VFS_ERROR;
+    if (offset > node->size) return VFS_ERROR;
 
-    if (ramfs_node->data == nullptr) {
-        ramfs_node->data = (uint8_t *)kmalloc(size);
-        ramfs_node->base.size = size;
-    } else if (offset + size > ramfs_node->base.size) {
-        ramfs_node->data = (uint8_t *)krealloc(ramfs_node->data, offset + size);
-        ramfs_node->base.size = offset + size;
-    } else if (offset + size < ramfs_node->base.size) {
-        memset(ramfs_node->data + offset + size, 0, ramfs_node->base.size - offset - size);
-    }
+    uint32_t within = offset % RAMFS_CHUNK_SIZE;
+    uint32_t available = node->size - offset;
+    if (!ramfs_node->backing && available > RAMFS_CHUNK_SIZE - within) available = RAMFS_CHUNK_SIZE - within;
+
+    *data = available ? ramfs_chunk(ramfs_node, offset) + within : nullptr;
+    *length = available;
+    return VFS_SUCCESS;
+}
 
-    memcpy(ramfs_node->data + offset, buffer, size);
-    ramfs_node->base.modification_time = get_rtc_timestamp();
+vfs_err_t ramfs_attach(struct vfs_node *file, const uint8_t *buffer, uint32_t size) {
+    struct vfs_ramfs_node *ramfs_node = (struct vfs_ramfs_node *)file;
+    if (file->type != VFS_RAMFS_FILE) return VFS_ERROR;
+    ramfs_free_chunks(ramfs_node);
+    ramfs_node->backing = size ? buffer : nullptr;
+    file->size = size;
     return VFS_SUCCESS;
 }
 
+int64_t ramfs_writev(struct vfs_node *node, vfs_off_t offset, const struct vfs_iovec *iov, uint32_t count) {
+    struct vfs_ramfs_node *ramfs_node = (struct vfs_ramfs_node *)node;
+    if (node->type != VFS_RAMFS_FILE) return -1;
+
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < count; i++) total += iov[i].length;
+    if (offset + total > UINT32_MAX) return -1;
+
+    // copy on first write, from then on the file lives in chunks like any other
+    if (ramfs_node->backing) {
+        const uint8_t *backing = ramfs_node->backing;
+        ramfs_node->backing = nullptr;
+        if (ramfs_store(ramfs_node, 0, node->size, backing) != VFS_SUCCESS) {
+            ramfs_free_chunks(ramfs_node);
+            ramfs_node->backing = backing;
+            return -1;
+        }
+    }
+
+    uint32_t position = offset;
+    for (uint32_t i = 0; i < count; i++) {
+        if (ramfs_store(ramfs_node, position, iov[i].length, iov[i].base) != VFS_SUCCESS) return -1;
+        position += iov[i].length;
+    }
+
+    // a write ending before the old end clears what was behind it, the size stays
+    if (position < node->size) {
+        ramfs_zero(ramfs_node, position, node->size);
+    } else {
+        node->size = position;
+    }
+
+    node->modification_time = get_rtc_timestamp();
+    return total;
+}
+
+vfs_err_t ramfs_write(struct vfs_node *node, uint32_t offset, uint32_t size, const uint8_t *buffer) {
+    struct vfs_iovec iov = { (void *)buffer, size };
+    return ramfs_writev(node, offset, &iov, 1) == size ? VFS_SUCCESS : VFS_ERROR;
+}
+
 vfs_err_t ramfs_create(struct vfs_node *parent, const char *name, vfs_node_type_t type, struct vfs_node **new_node) {
     if (parent->type != VFS_RAMFS_FOLDER) return VFS_NOT_PERMITTED;
 
     *new_node = vfs_create_node(name, type, parent);
     struct vfs_ramfs_node *ramfs_node = (struct vfs_ramfs_node *)(*new_node);
-    ramfs_node->data = nullptr;
+    ramfs_node->chunks = nullptr;
+    ramfs_node->chunk_slots = 0;
+    ramfs_node->backing = nullptr;
 
     parent->modification_time = get_rtc_timestamp();            
     return VFS_SUCCESS;
 }
 
+// Runs once the node is out of the tree and closed everywhere
+static void ramfs_release(struct vfs_node *node) {
+    if (node->type == VFS_RAMFS_FILE) ramfs_free_chunks((struct vfs_ramfs_node *)node);
+}
+
 vfs_err_t ramfs_remove(struct vfs_node *parent, struct vfs_node *node) {
     if (parent->type != VFS_RAMFS_FOLDER) return VFS_NOT_PERMITTED;
 
     vfs_remove_node(parent, node);
-
-    struct vfs_ramfs_node *ramfs_node = (struct vfs_ramfs_node *)node;
-    if (ramfs_node->data) kfree(ramfs_node->data);
     return VFS_SUCCESS;
 }
 
@@ -72,6 +242,7 @@ struct vfs_tree *vfs_initialize() {
     struct vfs_tree *vfs = (struct vfs_tree *)kmalloc(sizeof(struct vfs_tree));
     
     struct vfs_ramfs_node *ramfs_root = (struct vfs_ramfs_node *)kmalloc(sizeof(struct vfs_ramfs_node));
+    memset(ramfs_root, 0, sizeof(struct vfs_ramfs_node));
     struct vfs_node *root = &ramfs_root->base;
 
     root->name = strdup("/");
@@ -88,7 +259,14 @@ struct vfs_tree *vfs_initialize() {
     root->create = ramfs_create;
     root->remove = ramfs_remove;
 
-    ramfs_root->data = nullptr;
+    root->readv = ramfs_readv;
+    root->writev = ramfs_writev;
+    root->map = ramfs_map;
+    root->release = ramfs_release;
+
+    ramfs_root->chunks = nullptr;
+    ramfs_root->chunk_slots = 0;
+    ramfs_root->backing = nullptr;
 
     vfs->root = root;
     return vfs;
@@ -99,8 +277,12 @@ struct vfs_node *vfs_create_node(const char *name, vfs_node_type_t type, struct
 
     if (type == VFS_RAMFS_FILE || type == VFS_RAMFS_FOLDER) {
         struct vfs_ramfs_node *ramfs_node = (struct vfs_ramfs_node *)kmalloc(sizeof(struct vfs_ramfs_node));
+        if (!ramfs_node) return nullptr;
+        memset(ramfs_node, 0, sizeof(struct vfs_ramfs_node));
         node = &ramfs_node->base;
-        ramfs_node->data = nullptr;
+        ramfs_node->chunks = nullptr;
+        ramfs_node->chunk_slots = 0;
+        ramfs_node->backing = nullptr;
     } else {
         return nullptr;
     }
@@ -119,96 +301,189 @@ struct vfs_node *vfs_create_node(const char *name, vfs_node_type_t type, struct
         node->write = ramfs_write;
         node->create = ramfs_create;
         node->remove = ramfs_remove;
+        node->readv = ramfs_readv;
+        node->writev = ramfs_writev;
+        node->map = ramfs_map;
+        node->release = ramfs_release;
     }
 
     vfs_insert_node(parent, node);
     return node;
 }
 
-void vfs_insert_node(struct vfs_node *parent, struct vfs_node *node) {
-    if (!parent->children) {
-        parent->children = node;
-    } else {
-        struct vfs_node *sibling = parent->children;
-        while (sibling->next) {
-            sibling = sibling->next;
-        }
-        sibling->next = node;
+// FNV-1a
+uint32_t vfs_hash_name(const char *name) {
+    uint32_t hash = 2166136261u;
+    while (*name) {
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619u;
     }
+    return hash;
 }
 
-void vfs_remove_node(struct vfs_node *parent, struct vfs_node *node) {
-    if (parent->children == node) {
-        parent->children = node->next;
-    } else {
-        struct vfs_node *prev = parent->children;
-        while (prev && prev->next != node) {
-            prev = prev->next;
-        }
-        if (prev) prev->next = node->next;  
+static void vfs_index_link(struct vfs_node *parent, struct vfs_node *node) {
+    uint32_t bucket = node->name_hash & (parent->bucket_count - 1);
+    node->hash_next = parent->buckets[bucket];
+    parent->buckets[bucket] = node;
+}
+
+// Rehashes every child into twice the buckets, false leaves the old table alone when there is no memory for a bigger one
+static bool vfs_index_grow(struct vfs_node *parent) {
+    uint32_t count = parent->bucket_count ? parent->bucket_count * 2 : VFS_INITIAL_BUCKETS;
+    struct vfs_node **buckets = kmalloc(count * sizeof(struct vfs_node *));
+    if (!buckets) return false;
+    memset(buckets, 0, count * sizeof(struct vfs_node *));
+
+    struct vfs_node **old = parent->buckets;
+    parent->buckets = buckets;
+    parent->bucket_count = count;
+    for (struct vfs_node *child = parent->children; child; child = child->next) {
+        vfs_index_link(parent, child);
     }
+    if (old) kfree(old);
+    return true;
+}
+
+void vfs_insert_node(struct vfs_node *parent, struct vfs_node *node) {
+    node->name_hash = vfs_hash_name(node->name);
+    node->next = nullptr;
+    node->prev = parent->last_child;
+    if (parent->last_child) parent->last_child->next = node;
+    else parent->children = node;
+    parent->last_child = node;
+    parent->child_count++;
+
+    // the ordered list above already holds the node, growing rehashes it along with its siblings
+    if (parent->child_count > parent->bucket_count && vfs_index_grow(parent)) return;
+    if (parent->buckets) vfs_index_link(parent, node);
+}
 
-    if (node->children) {
-        struct vfs_node *child = node->children;
-        while (child) {
-            struct vfs_node *next_child = child->next;
-            vfs_remove_node(node, child);
-            child = next_child;
-        }   
+static void vfs_index_unlink(struct vfs_node *parent, struct vfs_node *node) {
+    if (!parent->buckets) return;
+    struct vfs_node **indirect = &parent->buckets[node->name_hash & (parent->bucket_count - 1)];
+    while (*indirect && *indirect != node) {
+        indirect = &(*indirect)->hash_next;
     }
+    if (*indirect) *indirect = node->hash_next;
+}
 
-    memset(node, 0, sizeof(struct vfs_node));
+void vfs_unlink_node(struct vfs_node *parent, struct vfs_node *node) {
+    if (node->prev) node->prev->next = node->next;
+    else parent->children = node->next;
+    if (node->next) node->next->prev = node->prev;
+    else parent->last_child = node->prev;
+    vfs_index_unlink(parent, node);
+    parent->child_count--;
+    node->next = node->prev = node->hash_next = nullptr;
+
+    // cached paths may lead to the node or through it
+    vfs_dcache_invalidate();
+}
+
+// Guards refcount against orphaned, whoever sees both drop to nothing frees the node
+static spinlock_t vfs_ref_lock = SPINLOCK_INIT;
+
+static void vfs_free_node(struct vfs_node *node) {
+    if (node->readpage) pagecache_invalidate(node);
+    if (node->release) node->release(node);
+    if (node->buckets) kfree(node->buckets);
     kfree(node->name);
+    memset(node, 0, sizeof(struct vfs_node));
     kfree(node);
 }
 
+HANDLE vfs_node_get(HANDLE handle) {
+    if (handle) __atomic_add_fetch(&handle->refcount, 1, __ATOMIC_RELAXED);
+    return handle;
+}
+
+void vfs_node_put(HANDLE handle) {
+    if (!handle) return;
+
+    // the last close stores what was written through the page cache, still holding the reference
+    if (handle->writepage && __atomic_load_n(&handle->refcount, __ATOMIC_RELAXED) == 1) pagecache_writeback(handle);
+
+    uint32_t flags = spin_lock_irqsave(&vfs_ref_lock);
+    bool last = --handle->refcount == 0 && handle->orphaned;
+    spin_unlock_irqrestore(&vfs_ref_lock, flags);
+    if (last) vfs_free_node(handle);
+}
+
+void vfs_remove_node(struct vfs_node *parent, struct vfs_node *node) {
+    vfs_unlink_node(parent, node);
+
+    while (node->children) {
+        vfs_remove_node(node, node->children);
+    }
+
+    uint32_t flags = spin_lock_irqsave(&vfs_ref_lock);
+    node->orphaned = true;
+    node->parent = nullptr;
+    bool unused = node->refcount == 0;
+    spin_unlock_irqrestore(&vfs_ref_lock, flags);
+    if (unused) vfs_free_node(node);
+}
+
 struct vfs_node *vfs_search_node(struct vfs_node *parent, const char *name) {
-    struct vfs_node *current = parent->children;
-    while (current) {
-        if (strcmp(current->name, name) == 0) return current;
-        current = current->next;
+    if (!parent->buckets) return nullptr;
+
+    uint32_t hash = vfs_hash_name(name);
+    for (struct vfs_node *current = parent->buckets[hash & (parent->bucket_count - 1)]; current; current = current->hash_next) {
+        if (current->name_hash == hash && strcmp(current->name, name) == 0) return current;
     }
     return nullptr;
 }
 
 int vfs_read(struct vfs_node *file, uint32_t offset, uint32_t size, uint8_t *buffer) {
+    if (file->readpage) return read(file, offset, size, buffer);
     if (file->read) return file->read(file, offset, size, buffer);
     return VFS_NOT_PERMITTED;
 }
 
 int vfs_write(struct vfs_node *file, uint32_t offset, uint32_t size, const uint8_t *buffer) {
+    if (file->readpage) return write(file, offset, size, buffer);
     if (file->write) return file->write(file, offset, size, buffer);
     return VFS_NOT_PERMITTED;
 }
 
+static struct vfs_node *vfs_mounted_root(struct vfs_node *node) {
+    for (struct vfs_mount *mount = g_mounts; mount; mount = mount->next) {
+        if (mount->mount_point == node) return mount->mounted_root;
+    }
+    return node;
+}
+
 struct vfs_node *vfs_traverse_path(struct vfs_tree *vfs, const char *path) {
     if (!path || *path == '\0') return nullptr;
 
-    char *path_copy = strdup(path);
-    if (!path_copy) return nullptr;
+    uint32_t hash = vfs_hash_name(path);
+    struct vfs_node *cached = vfs_dcache_lookup(vfs, path, hash);
+    if (cached) return cached;
 
-    char *token = strtok(path_copy, "/");
+    uint32_t generation = vfs_dcache_generation();
     struct vfs_node *current = vfs->root;
+    char name[VFS_NAME_MAX];
 
-    while (token) {
-        struct vfs_mount *mount = g_mounts;
-        while (mount) {
-            if (mount->mount_point == current) {
-                current = mount->mounted_root;
-                break;
-            }
-            mount = mount->next;
+    const char *component = path;
+    while (*component) {
+        if (*component == '/') {
+            component++;
+            continue;
         }
 
-        current = vfs_search_node(current, token);
-        if (!current) {
-            kfree(path_copy);
-            return nullptr;
-        }
-        token = strtok(nullptr, "/");
+        size_t length = 0;
+        while (component[length] && component[length] != '/') length++;
+        if (length >= sizeof(name)) return nullptr;
+        memcpy(name, component, length);
+        name[length] = '\0';
+        component += length;
+
+        if (current->mount_point) current = vfs_mounted_root(current);
+        current = vfs_search_node(current, name);
+        if (!current) return nullptr;
     }
 
-    kfree(path_copy);
+    vfs_dcache_insert(vfs, path, hash, generation, current);
     return current;
 }
 
@@ -253,23 +528,92 @@ vfs_err_t create(const char* path, vfs_node_type_t type) {
 }
 
 HANDLE open(const char* path) {
-    return vfs_traverse_path(g_Vfs, path);
+    return vfs_node_get(vfs_traverse_path(g_Vfs, path));
 }
 
 vfs_err_t close(HANDLE handle) {
-    return handle ? VFS_SUCCESS : VFS_ERROR;
+    if (!handle) return VFS_ERROR;
+    vfs_node_put(handle);
+    return VFS_SUCCESS;
+}
+
+vfs_err_t sync() {
+    bool ok = pagecache_sync();
+    ok = bcache_sync(nullptr) && ok;
+    return ok ? VFS_SUCCESS : VFS_ERROR;
 }
 
 vfs_err_t read(HANDLE handle, uint32_t offset, uint32_t size, uint8_t* buffer) {
+    if (handle && handle->readpage) {
+        if (offset > handle->size || size > handle->size - offset) return VFS_ERROR;
+        return pread(handle, buffer, size, offset) == size ? VFS_SUCCESS : VFS_ERROR;
+    }
     if (!handle || !handle->read) return VFS_ERROR;
     return handle->read(handle, offset, size, buffer);
 }
 
 vfs_err_t write(HANDLE handle, uint32_t offset, uint32_t size, const uint8_t* buffer) {
+    if (handle && handle->readpage) return pwrite(handle, buffer, size, offset) == size ? VFS_SUCCESS : VFS_ERROR;
     if (!handle || !handle->write) return VFS_ERROR;
     return handle->write(handle, offset, size, buffer);
 }
 
+// For filesystems without vectored ops, the single buffer ones only reach the first 4 GiB
+static int64_t vfs_generic_readv(HANDLE handle, vfs_off_t offset, const struct vfs_iovec* iov, uint32_t count) {
+    int64_t done = 0;
+    for (uint32_t i = 0; i < count && offset < handle->size; i++) {
+        size_t length = iov[i].length < handle->size - offset ? iov[i].length : handle->size - offset;
+        if (offset + length > UINT32_MAX || handle->read(handle, offset, length, iov[i].base) != VFS_SUCCESS) {
+            return done ? done : -1;
+        }
+        offset += length;
+        done += length;
+    }
+    return done;
+}
+
+static int64_t vfs_generic_writev(HANDLE handle, vfs_off_t offset, const struct vfs_iovec* iov, uint32_t count) {
+    int64_t done = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (offset + iov[i].length > UINT32_MAX || handle->write(handle, offset, iov[i].length, iov[i].base) != VFS_SUCCESS) {
+            return -1;
+        }
+        offset += iov[i].length;
+        done += iov[i].length;
+    }
+    return done;
+}
+
+int64_t preadv(HANDLE handle, const struct vfs_iovec* iov, uint32_t count, vfs_off_t offset) {
+    if (!handle || count > VFS_IOV_MAX) return -1;
+    if (handle->readpage) return pagecache_readv(handle, offset, iov, count);
+    if (handle->readv) return handle->readv(handle, offset, iov, count);
+    return handle->read ? vfs_generic_readv(handle, offset, iov, count) : -1;
+}
+
+int64_t pwritev(HANDLE handle, const struct vfs_iovec* iov, uint32_t count, vfs_off_t offset) {
+    if (!handle || count > VFS_IOV_MAX) return -1;
+    if (handle->readpage) return pagecache_writev(handle, offset, iov, count);
+    if (handle->writev) return handle->writev(handle, offset, iov, count);
+    return handle->write ? vfs_generic_writev(handle, offset, iov, count) : -1;
+}
+
+int64_t pread(HANDLE handle, void* buffer, size_t size, vfs_off_t offset) {
+    struct vfs_iovec iov = { buffer, size };
+    return preadv(handle, &iov, 1, offset);
+}
+
+int64_t pwrite(HANDLE handle, const void* buffer, size_t size, vfs_off_t offset) {
+    struct vfs_iovec iov = { (void*)buffer, size };
+    return pwritev(handle, &iov, 1, offset);
+}
+
+vfs_err_t read_direct(HANDLE handle, uint32_t offset, const uint8_t** data, uint32_t* length) {
+    if (!handle) return VFS_ERROR;
+    if (!handle->map) return VFS_NOT_PERMITTED;
+    return handle->map(handle, offset, data, length);
+}
+
 /**
  * 
  *          MOUNTING
@@ -293,13 +637,9 @@ vfs_err_t vfs_mount(const char *target_path, struct vfs_node *filesystem_root) {
     g_mounts = new_mount;
 
     filesystem_root->parent = mount_point;
-    if (!mount_point->children) {
-        mount_point->children = filesystem_root;
-    } else {
-        struct vfs_node *child = mount_point->children;
-        while (child->next) child = child->next;
-        child->next = filesystem_root;
-    }
+    mount_point->mount_point = true;
+    vfs_insert_node(mount_point, filesystem_root);
+    vfs_dcache_invalidate();
 
     return VFS_SUCCESS;
 }
@@ -316,14 +656,12 @@ vfs_err_t vfs_unmount(const char *target_path) {
     while (mount) {
         if (mount->mount_point == mount_point) {
             *prev_mount = mount->next;
-            if (mount_point->children == mount->mounted_root) {
-                mount_point->children = mount->mounted_root->next;
-            } else {
-                struct vfs_node *child = mount_point->children;
-                while (child && child->next != mount->mounted_root) {
-                    child = child->next;
-                }
-                if (child) child->next = mount->mounted_root->next;
+            vfs_unlink_node(mount_point, mount->mounted_root);
+
+            // the same directory can carry several mounts, the flag goes with the last one
+            mount_point->mount_point = false;
+            for (struct vfs_mount *other = g_mounts; other; other = other->next) {
+                if (other->mount_point == mount_point) mount_point->mount_point = true;
             }
 
             kfree(mount);
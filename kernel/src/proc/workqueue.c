@@ -0,0 +1,108 @@
+#include <proc/workqueue.h>
+#include <proc/sched.h>
+#include <kheap.h>
+#include <string.h>
+#include <kprintf>
+
+#define SYSTEM_WQ_WORKERS 2
+#define SYSTEM_WQ_RT_PRIORITY 50
+
+struct workqueue *system_wq = nullptr;
+
+static void worker_main(struct worker *worker) {
+    struct workqueue *queue = worker->queue;
+
+    for (;;) {
+        uint32_t flags = spin_lock_irqsave(&queue->lock);
+        while (!queue->head) {
+            sched_sleep_on(&queue->idle, &queue->lock);
+        }
+
+        struct work *work = queue->head;
+        queue->head = work->next;
+        if (!queue->head) queue->tail = nullptr;
+        queue->dequeued_seq = work->seq + 1;
+
+        // cleared before running so the function may requeue its own work
+        work->pending = false;
+        worker->busy = true;
+        worker->running_seq = work->seq;
+        spin_unlock_irqrestore(&queue->lock, flags);
+
+        work->func(work);
+
+        flags = spin_lock_irqsave(&queue->lock);
+        worker->busy = false;
+        sched_wake_all(&queue->flushers);
+        spin_unlock_irqrestore(&queue->lock, flags);
+    }
+}
+
+struct workqueue *workqueue_create(uint32_t workers, uint32_t rt_priority) {
+    if (workers == 0 || workers > WORKQUEUE_MAX_WORKERS) workers = WORKQUEUE_MAX_WORKERS;
+
+    struct workqueue *queue = kmalloc(sizeof(struct workqueue));
+    if (!queue) return nullptr;
+    memset(queue, 0, sizeof(struct workqueue));
+    spin_init(&queue->lock);
+
+    for (uint32_t i = 0; i < workers; i++) {
+        struct worker *worker = &queue->workers[i];
+        worker->queue = queue;
+        worker->task = task_create_arg((uintptr_t)worker_main, (uintptr_t)worker, 0, 0, kernel_page_directory);
+        if (!worker->task) {
+            kprintf("workqueue: failed to spawn worker %u\n", i);
+            break;
+        }
+        if (rt_priority) sched_set_fifo(worker->task, rt_priority);
+        queue->worker_count++;
+        sched_add_task(worker->task);
+    }
+
+    return queue;
+}
+
+void workqueue_init() {
+    system_wq = workqueue_create(SYSTEM_WQ_WORKERS, SYSTEM_WQ_RT_PRIORITY);
+}
+
+bool queue_work(struct workqueue *queue, struct work *work) {
+    uint32_t flags = spin_lock_irqsave(&queue->lock);
+    if (work->pending) {
+        spin_unlock_irqrestore(&queue->lock, flags);
+        return false;
+    }
+
+    work->pending = true;
+    work->next = nullptr;
+    work->seq = queue->queued_seq++;
+    if (queue->tail) queue->tail->next = work;
+    else queue->head = work;
+    queue->tail = work;
+
+    sched_wake_one(&queue->idle);
+    spin_unlock_irqrestore(&queue->lock, flags);
+    return true;
+}
+
+static bool seq_before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
+
+// Everything queued before `target` has been picked up and no worker still runs one of those
+static bool flushed(struct workqueue *queue, uint32_t target) {
+    if (seq_before(queue->dequeued_seq, target)) return false;
+    for (uint32_t i = 0; i < queue->worker_count; i++) {
+        if (queue->workers[i].busy && seq_before(queue->workers[i].running_seq, target)) return false;
+    }
+    return true;
+}
+
+void flush_workqueue(struct workqueue *queue) {
+    uint32_t flags = spin_lock_irqsave(&queue->lock);
+    uint32_t target = queue->queued_seq;
+    while (!flushed(queue, target)) {
+        sched_sleep_on(&queue->flushers, &queue->lock);
+    }
+    spin_unlock_irqrestore(&queue->lock, flags);
+}
@@ -80,24 +80,28 @@ void rb_insert_fixup(struct rb_tree *tree, struct rb_node *z) {
     tree->root->color = BLACK;
 }
 
-void rb_insert(struct rb_tree *tree, uintptr_t key) {
-    struct rb_node *z = rb_new_node(key);
+static bool key_less(const struct rb_node *a, const struct rb_node *b) {
+    return a->key < b->key;
+}
+
+void rb_link(struct rb_tree *tree, struct rb_node *z, bool (*less)(const struct rb_node *a, const struct rb_node *b)) {
     struct rb_node *y = nullptr;
     struct rb_node *x = tree->root;
-    
-    kprintf("z=0x%p, y=0x%p, x=0x%p\n", z, y, x);
+
     while (x != nullptr) {
         y = x;
-        if (z->key < x->key)
+        if (less(z, x))
             x = x->left;
         else
             x = x->right;
     }
+
+    z->color = RED;
+    z->left = z->right = nullptr;
     z->parent = y;
-    
     if (y == nullptr)
         tree->root = z;
-    else if (z->key < y->key)
+    else if (less(z, y))
         y->left = z;
     else
         y->right = z;
@@ -105,6 +109,10 @@ void rb_insert(struct rb_tree *tree, uintptr_t key) {
     rb_insert_fixup(tree, z);
 }
 
+void rb_insert(struct rb_tree *tree, uintptr_t key) {
+    rb_link(tree, rb_new_node(key), key_less);
+}
+
 void rb_inorder(struct rb_node *root) {
     if (root != nullptr) {
         rb_inorder(root->left);
@@ -136,63 +144,91 @@ struct rb_node *rb_minimum(struct rb_node *node) {
     return node;
 }
 
-void rb_delete_fixup(struct rb_tree *tree, struct rb_node *x) {
+struct rb_node *rb_first(struct rb_tree *tree) {
+    return tree->root ? rb_minimum(tree->root) : nullptr;
+}
+
+struct rb_node *rb_last(struct rb_tree *tree) {
+    struct rb_node *node = tree->root;
+    while (node != nullptr && node->right != nullptr)
+        node = node->right;
+    return node;
+}
+
+struct rb_node *rb_next(struct rb_node *node) {
+    if (node->right != nullptr)
+        return rb_minimum(node->right);
+    while (node->parent != nullptr && node == node->parent->right)
+        node = node->parent;
+    return node->parent;
+}
+
+static void rb_transplant(struct rb_tree *tree, struct rb_node *u, struct rb_node *v) {
+    if (u->parent == nullptr)
+        tree->root = v;
+    else if (u == u->parent->left)
+        u->parent->left = v;
+    else
+        u->parent->right = v;
+    if (v != nullptr)
+        v->parent = u->parent;
+}
+
+// `x` may be a nil leaf, so its parent is passed along explicitly
+static void rb_erase_fixup(struct rb_tree *tree, struct rb_node *x, struct rb_node *parent) {
     while (x != tree->root && (x == nullptr || x->color == BLACK)) {
-        if (x == x->parent->left) {
-            struct rb_node *w = x->parent->right;
-            if (w == nullptr) {
-                break;
-            }
+        if (x == parent->left) {
+            struct rb_node *w = parent->right;
             if (w->color == RED) {
                 w->color = BLACK;
-                x->parent->color = RED;
-                rb_rotate_left(tree, x->parent);
-                w = x->parent->right;
+                parent->color = RED;
+                rb_rotate_left(tree, parent);
+                w = parent->right;
             }
             if ((w->left == nullptr || w->left->color == BLACK) &&
                 (w->right == nullptr || w->right->color == BLACK)) {
                 w->color = RED;
-                x = x->parent;
+                x = parent;
+                parent = x->parent;
             } else {
                 if (w->right == nullptr || w->right->color == BLACK) {
-                    if (w->left != nullptr)
-                        w->left->color = BLACK;
+                    w->left->color = BLACK;
                     w->color = RED;
                     rb_rotate_right(tree, w);
-                    w = x->parent->right;
+                    w = parent->right;
                 }
-                w->color = x->parent->color;
-                x->parent->color = BLACK;
+                w->color = parent->color;
+                parent->color = BLACK;
                 if (w->right != nullptr)
                     w->right->color = BLACK;
-                rb_rotate_left(tree, x->parent);
+                rb_rotate_left(tree, parent);
                 x = tree->root;
             }
         } else {
-            struct rb_node *w = x->parent->left;
+            struct rb_node *w = parent->left;
             if (w->color == RED) {
                 w->color = BLACK;
-                x->parent->color = RED;
-                rb_rotate_right(tree, x->parent);
-                w = x->parent->left;
+                parent->color = RED;
+                rb_rotate_right(tree, parent);
+                w = parent->left;
             }
             if ((w->right == nullptr || w->right->color == BLACK) &&
                 (w->left == nullptr || w->left->color == BLACK)) {
                 w->color = RED;
-                x = x->parent;
+                x = parent;
+                parent = x->parent;
             } else {
                 if (w->left == nullptr || w->left->color == BLACK) {
-                    if (w->right != nullptr)
-                        w->right->color = BLACK;
+                    w->right->color = BLACK;
                     w->color = RED;
                     rb_rotate_left(tree, w);
-                    w = x->parent->left;
+                    w = parent->left;
                 }
-                w->color = x->parent->color;
-                x->parent->color = BLACK;
+                w->color = parent->color;
+                parent->color = BLACK;
                 if (w->left != nullptr)
                     w->left->color = BLACK;
-                rb_rotate_right(tree, x->parent);
+                rb_rotate_right(tree, parent);
                 x = tree->root;
             }
         }
@@ -201,70 +237,50 @@ void rb_delete_fixup(struct rb_tree *tree, struct rb_node *x) {
         x->color = BLACK;
 }
 
-
-void rb_delete(struct rb_tree *tree, uintptr_t key) {
-    struct rb_node *z = rb_search(tree, key);
-    if (z == nullptr)
-        return;
-
-    struct rb_node *y = z;
-    struct rb_node *x = nullptr;
-    enum rb_color y_original_color = y->color;
+void rb_erase(struct rb_tree *tree, struct rb_node *z) {
+    struct rb_node *x;
+    struct rb_node *x_parent;
+    enum rb_color removed_color = z->color;
 
     if (z->left == nullptr) {
         x = z->right;
-        if (x != nullptr)
-            x->parent = z->parent;
-        if (z->parent == nullptr) {
-            tree->root = x;
-        } else if (z == z->parent->left) {
-            z->parent->left = x;
-        } else {
-            z->parent->right = x;
-        }
-        kfree(z);
+        x_parent = z->parent;
+        rb_transplant(tree, z, z->right);
     } else if (z->right == nullptr) {
         x = z->left;
-        if (x != nullptr)
-            x->parent = z->parent;
-        if (z->parent == nullptr) {
-            tree->root = x;
-        } else if (z == z->parent->left) {
-            z->parent->left = x;
-        } else {
-            z->parent->right = x;
-        }
-        kfree(z);
+        x_parent = z->parent;
+        rb_transplant(tree, z, z->left);
     } else {
-        y = rb_minimum(z->right);
-        y_original_color = y->color;
+        struct rb_node *y = rb_minimum(z->right);
+        removed_color = y->color;
         x = y->right;
 
-        if (y->parent != z) {
-            if (x != nullptr)
-                x->parent = y->parent;
-            y->parent->left = x;
-            y->right = z->right;
-            z->right->parent = y;
-        }
-        
-        if (z->parent == nullptr) {
-            tree->root = y;
-        } else if (z == z->parent->left) {
-            z->parent->left = y;
+        if (y->parent == z) {
+            x_parent = y;
         } else {
-            z->parent->right = y;
+            x_parent = y->parent;
+            rb_transplant(tree, y, y->right);
+            y->right = z->right;
+            y->right->parent = y;
         }
 
-        y->parent = z->parent;
+        rb_transplant(tree, z, y);
         y->left = z->left;
-        z->left->parent = y;
+        y->left->parent = y;
         y->color = z->color;
-        kfree(z);
     }
 
-    if (y_original_color == BLACK && x != nullptr) {
-        rb_delete_fixup(tree, x);
-    }
+    if (removed_color == BLACK)
+        rb_erase_fixup(tree, x, x_parent);
+
+    z->left = z->right = z->parent = nullptr;
 }
 
+void rb_delete(struct rb_tree *tree, uintptr_t key) {
+    struct rb_node *z = rb_search(tree, key);
+    if (z == nullptr)
+        return;
+
+    rb_erase(tree, z);
+    kfree(z);
+}
@@ -31,6 +31,14 @@ uint32_t inl(uint16_t port) {
     return ret;
 }
 
+void insw(uint16_t port, void *buffer, uint32_t count) {
+    __asm__ volatile ("cld; rep insw" : "+D"(buffer), "+c"(count) : "d"(port) : "memory");
+}
+
+void outsw(uint16_t port, const void *buffer, uint32_t count) {
+    __asm__ volatile ("cld; rep outsw" : "+S"(buffer), "+c"(count) : "d"(port) : "memory");
+}
+
 void cli() {
     __asm__ volatile ("cli");
 }
@@ -55,6 +63,14 @@ int is_interrupts_enabled() {
     return (eflags & 0x200) != 0;
 }
 
+uint64_t tsc_frequency = 0;
+
+uint64_t rdtsc() {
+    uint32_t low, high;
+    __asm__ volatile ("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
 uint64_t read_msr(uint32_t msr) {
     uint32_t low, high;
     __asm__ volatile ("rdmsr" : "=a"(low), "=d"(high) : "c"(msr));
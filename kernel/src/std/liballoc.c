@@ -3,6 +3,7 @@
 #include <string.h>
 #include <io.h>
 #include <kprintf>
+#include <proc/spinlock.h>
 
 /**  Durand's Amazing Super Duper Memory functions.  */
 
@@ -17,14 +18,17 @@
 #define USE_CASE4
 #define USE_CASE5
 
-//TODO: Mutexes?
+// Spinlock so other CPUs stay out too, the saved eflags put IF back the way the caller had it
+static spinlock_t heap_lock = SPINLOCK_INIT;
+static uint32_t heap_lock_flags;
+
 extern int liballoc_lock() {
-	cli();
+	heap_lock_flags = spin_lock_irqsave(&heap_lock);
 	return 0;
 }
 extern int liballoc_unlock()
 {
-	sti();
+	spin_unlock_irqrestore(&heap_lock, heap_lock_flags);
 	return 0;
 }
 extern uintptr_t higher_half_base;
@@ -0,0 +1,79 @@
+[bits 16]
+section .text
+
+global ap_trampoline_start
+global ap_trampoline_end
+global ap_trampoline_far_jump
+global ap_trampoline_base
+global ap_trampoline_gdtr
+global ap_trampoline_cr3
+global ap_trampoline_stack
+global ap_trampoline_entry
+global ap_trampoline_cpu
+
+; Copied to a page below 1 MiB and entered through the STARTUP IPI with CS = page >> 4, IP = 0.
+; Everything is addressed relative to ap_trampoline_start, the BSP patches the absolute
+; addresses in before sending the IPI.
+%define OFFSET(label) (label - ap_trampoline_start)
+
+ap_trampoline_start:
+    cli
+    cld
+    mov ax, cs
+    mov ds, ax
+    o32 lgdt [OFFSET(ap_trampoline_gdtr)]
+
+    mov eax, cr0
+    or eax, 1
+    mov cr0, eax
+
+    ; jmp dword 0x08:<physical address of ap_trampoline_protected>
+    db 0x66, 0xEA
+ap_trampoline_far_jump:
+    dd 0
+    dw 0x08
+
+[bits 32]
+ap_trampoline_protected:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov ss, ax
+    xor ax, ax
+    mov fs, ax
+    mov gs, ax
+
+    ; mov ebx, <physical address of ap_trampoline_start>
+    db 0xBB
+ap_trampoline_base:
+    dd 0
+
+    ; the page is identity mapped in the kernel directory while APs boot
+    mov eax, [ebx + OFFSET(ap_trampoline_cr3)]
+    mov cr3, eax
+    mov eax, cr0
+    or eax, 0x80000000
+    mov cr0, eax
+
+    mov esp, [ebx + OFFSET(ap_trampoline_stack)]
+    push dword [ebx + OFFSET(ap_trampoline_cpu)]
+    push dword 0
+    jmp dword [ebx + OFFSET(ap_trampoline_entry)]
+
+align 8
+ap_trampoline_gdt:
+    dq 0
+    dq 0x00CF9A000000FFFF   ; flat code, same selector as the kernel
+    dq 0x00CF92000000FFFF   ; flat data
+ap_trampoline_gdtr:
+    dw 23
+    dd 0
+ap_trampoline_cr3:
+    dd 0
+ap_trampoline_stack:
+    dd 0
+ap_trampoline_entry:
+    dd 0
+ap_trampoline_cpu:
+    dd 0
+ap_trampoline_end:
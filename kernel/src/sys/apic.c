@@ -0,0 +1,95 @@
+#include <sys/apic.h>
+#include <sys/idt.h>
+#include <sys/mm/vmm.h>
+#include <kprintf>
+#include <io.h>
+#include <string.h>
+
+volatile uint32_t* lapic = nullptr;
+uint32_t lapic_timer_frequency = 0;
+
+#define PIT_FREQUENCY           1193182
+#define PIT_CHANNEL2_PORT       0x42
+#define PIT_COMMAND_PORT        0x43
+#define PIT_GATE_PORT           0x61
+#define CALIBRATION_HZ          100     // 10ms window
+
+bool lapic_supported() {
+    uint32_t eax, ebx, ecx, edx;
+    __asm__ volatile ("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+    return (edx & (1 << 9)) != 0;
+}
+
+void lapic_map(uint32_t physical_address) {
+    vmm_map_page(&kernel_page_directory, LAPIC_VIRT_BASE, PAGE_SIZE, physical_address, PAGE_PRESENT | PAGE_RW | PAGE_CACHE_DISABLE);
+    lapic = (volatile uint32_t*)LAPIC_VIRT_BASE;
+}
+
+static void lapic_spurious_handler(registers_t*)
+{
+    // no EOI for spurious interrupts
+}
+
+// Brings up the calling CPU's local APIC, every CPU runs this for itself
+void lapic_init() {
+    idt_register_handler(LAPIC_SPURIOUS_VECTOR, lapic_spurious_handler);
+
+    lapic_write(LAPIC_REG_TPR, 0);
+    lapic_write(LAPIC_REG_LVT_ERROR, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_REG_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+
+    lapic_write(LAPIC_REG_ESR, 0);
+    lapic_write(LAPIC_REG_ESR, 0);
+    lapic_eoi();
+}
+
+bool lapic_timer_calibrate() {
+    // channel 2 in mode 0 raises OUT2 (bit 5 of port 0x61) once the count runs out, the speaker stays off
+    uint8_t gate = inb(PIT_GATE_PORT) & ~0x03;
+    outb(PIT_GATE_PORT, gate);
+    outb(PIT_COMMAND_PORT, 0xB0);
+    uint16_t count = PIT_FREQUENCY / CALIBRATION_HZ;
+    outb(PIT_CHANNEL2_PORT, count & 0xFF);
+    outb(PIT_CHANNEL2_PORT, count >> 8);
+
+    lapic_write(LAPIC_REG_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+    lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_LVT_MASKED);
+
+    outb(PIT_GATE_PORT, gate | 0x01);
+    lapic_write(LAPIC_REG_TIMER_INITIAL, 0xFFFFFFFF);
+    uint64_t tsc_start = rdtsc();
+    while (!(inb(PIT_GATE_PORT) & 0x20));
+    uint32_t elapsed = 0xFFFFFFFF - lapic_read(LAPIC_REG_TIMER_CURRENT);
+    tsc_frequency = (rdtsc() - tsc_start) * CALIBRATION_HZ;
+
+    lapic_write(LAPIC_REG_TIMER_INITIAL, 0);
+    outb(PIT_GATE_PORT, gate);
+
+    lapic_timer_frequency = elapsed * CALIBRATION_HZ;
+    kprintf("LAPIC: timer runs at %lu Hz\n", lapic_timer_frequency);
+    return lapic_timer_frequency != 0;
+}
+
+void lapic_timer_start(uint8_t vector, uint32_t hz) {
+    lapic_write(LAPIC_REG_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+    lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_TIMER_PERIODIC | vector);
+    lapic_write(LAPIC_REG_TIMER_INITIAL, lapic_timer_frequency / hz);
+}
+
+static void lapic_wait_icr() {
+    while (lapic_read(LAPIC_REG_ICR_LOW) & LAPIC_ICR_PENDING)
+        __asm__ volatile ("pause");
+}
+
+void lapic_send_ipi(uint8_t apic_id, uint32_t command) {
+    lapic_wait_icr();
+    lapic_write(LAPIC_REG_ICR_HIGH, (uint32_t)apic_id << 24);
+    lapic_write(LAPIC_REG_ICR_LOW, command);
+    lapic_wait_icr();
+}
+
+void lapic_broadcast_ipi(uint8_t vector) {
+    lapic_wait_icr();
+    lapic_write(LAPIC_REG_ICR_HIGH, 0);
+    lapic_write(LAPIC_REG_ICR_LOW, LAPIC_ICR_ALL_BUT_SELF | LAPIC_ICR_ASSERT | LAPIC_ICR_FIXED | vector);
+}
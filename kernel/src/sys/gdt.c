@@ -6,7 +6,7 @@ gdt_t gdt;
 gdt_pointer_t gdt_ptr;
 tss_t tss = {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
 
-void gdt_load() {
+void gdt_load(gdt_pointer_t* pointer) {
     __asm__ volatile (
         "lgdtl (%0)\n"
         "mov $0x10, %%ax\n"
@@ -17,15 +17,15 @@ void gdt_load() {
         "pushl $1f\n"
         "retf\n"
         "1:\n"
-        : : "r" (&gdt_ptr)
+        : : "r" (pointer)
         : "ax"
     );
 }
 
-void gdt_init() {
-    gdt.entries[0] = (gdt_entry_t){0,0,0,0,0,0};  // Null segment
+void gdt_setup(gdt_t* table, gdt_pointer_t* pointer, tss_t* task_state, uint32_t esp0) {
+    table->entries[0] = (gdt_entry_t){0,0,0,0,0,0};  // Null segment
 
-    gdt.entries[1] = (gdt_entry_t){               // Kernel Code32
+    table->entries[1] = (gdt_entry_t){               // Kernel Code32
         .limit = 0xFFFF,
         .base_low = 0x0000,
         .base_mid = 0x00,
@@ -34,7 +34,7 @@ void gdt_init() {
         .base_high = 0x00
     };
 
-    gdt.entries[2] = (gdt_entry_t){               // Kernel Data32
+    table->entries[2] = (gdt_entry_t){               // Kernel Data32
         .limit = 0xFFFF,
         .base_low = 0x0000,
         .base_mid = 0x00,
@@ -43,7 +43,7 @@ void gdt_init() {
         .base_high = 0x00
     };
 
-    gdt.entries[3] = (gdt_entry_t){               // User Code32
+    table->entries[3] = (gdt_entry_t){               // User Code32
         .limit = 0xFFFF,
         .base_low = 0x0000,
         .base_mid = 0x00,
@@ -52,7 +52,7 @@ void gdt_init() {
         .base_high = 0x00
     };
 
-    gdt.entries[4] = (gdt_entry_t){               // User Data32
+    table->entries[4] = (gdt_entry_t){               // User Data32
         .limit = 0xFFFF,
         .base_low = 0x0000,
         .base_mid = 0x00,
@@ -61,24 +61,30 @@ void gdt_init() {
         .base_high = 0x00
     };
 
-    uint32_t tss_base = (uint32_t)&tss;
+    uint32_t tss_base = (uint32_t)task_state;
     uint32_t tss_limit = sizeof(tss_t);
 
-    gdt.tss.limit = tss_limit & 0xFFFF;
-    gdt.tss.access = 0x89;
-    gdt.tss.granularity = ((tss_limit & 0xF0000) >> 16) | (0x00);
-    gdt.tss.base_low = tss_base & 0xFFFF;
-    gdt.tss.base_mid = (tss_base >> 16) & 0xFF;
-    gdt.tss.base_high = (tss_base >> 24) & 0xFF;
+    table->tss.limit = tss_limit & 0xFFFF;
+    table->tss.access = 0x89;
+    table->tss.granularity = ((tss_limit & 0xF0000) >> 16) | (0x00);
+    table->tss.base_low = tss_base & 0xFFFF;
+    table->tss.base_mid = (tss_base >> 16) & 0xFF;
+    table->tss.base_high = (tss_base >> 24) & 0xFF;
+
+    pointer->limit = sizeof(gdt_t) - 1;
+    pointer->base = (uint32_t)table;
+
+    memset(task_state, 0, sizeof(tss_t));
+    task_state->ss0 = 0x10;
+    task_state->esp0 = esp0;
+    task_state->iomap_base = sizeof(tss_t);
 
-    gdt_ptr.limit = sizeof(gdt) - 1;
-    gdt_ptr.base = (uint32_t)&gdt;
+    gdt_load(pointer);
+    __asm__ volatile ("ltr %w0" : : "r" (GDT_TSS_SELECTOR));
+}
 
-    memset(&tss, 0, sizeof(tss));
-    tss.ss0 = 0x10;
+void gdt_init() {
     uint32_t stackAddr;
     __asm__ volatile ("mov %%esp, %0" : "=r" (stackAddr));
-    tss.esp0 = stackAddr;
-
-    gdt_load();
+    gdt_setup(&gdt, &gdt_ptr, &tss, stackAddr);
 }
\ No newline at end of file
@@ -1,12 +1,16 @@
 #include <sys/idt.h>
 #include <sys/gdt.h>
 #include <sys/pic.h>
+#include <sys/smp.h>
+#include <sys/apic.h>
+#include <sys/ioapic.h>
+#include <sys/syscall.h>
+#include <proc/sched.h>
+#include <proc/sched_trace.h>
 #include <kprintf>
 #include <string.h>
 #include <io.h>
 
-#define PIC_REMAP_OFFSET        0x20
-
 __attribute__((aligned(16))) idt_entry_t idt[256];
 
 idt_pointer_t idt_ptr = { sizeof(idt) - 1, (uintptr_t)&idt };
@@ -14,6 +18,9 @@ idt_pointer_t idt_ptr = { sizeof(idt) - 1, (uintptr_t)&idt };
 ISRHandler handlers[256];
 IRQHandler irq_handlers[16];
 
+// Per CPU so the dispatch path never shares a cache line or needs a lock
+static irq_stat_t irq_stats[MAX_CPUS][256];
+
 static const char* const g_Exceptions[] = {
     "Divide by zero error",
     "Debug",
@@ -63,11 +70,85 @@ void idt_init()
     for (int i = 0; i < 16; i++)
         idt_register_handler(PIC_REMAP_OFFSET + i, irq_default_handler);
     
+    idt_load();
+}
+
+// The table is shared, application processors only need to load it
+void idt_load()
+{
     __asm__ volatile ("lidt %0" : : "m" (idt_ptr) : "memory");
 }
 
-void idt_default_handler(registers_t* regs)
+// Only called from handlers running with interrupts disabled, the request is consumed before anything can nest
+void idt_switch_frame(registers_t* frame)
+{
+    this_cpu()->switch_frame = frame;
+}
+
+void idt_release_on_exit(volatile bool* flag)
 {
+    this_cpu()->release_on_exit = flag;
+}
+
+// Called by isr_common once it is running on the new frame's stack
+void idt_finish_switch()
+{
+    struct cpu* cpu = this_cpu();
+    if (cpu->release_on_exit) {
+        *cpu->release_on_exit = false;
+        cpu->release_on_exit = nullptr;
+    }
+}
+
+void idt_unhandled_exception(registers_t* regs)
+{
+    if ((regs->cs & 3) == 3) {
+        uint32_t cr2;
+        __asm__ volatile ("mov %%cr2, %0" : "=r" (cr2));
+        kprintf("pid %lu killed: exception %d %s at eip 0x%lx (cr2 = 0x%lx, error = 0x%lx)\n",
+               current_task->pid, regs->interrupt, g_Exceptions[regs->interrupt], regs->eip, cr2, regs->error);
+        // the task never comes back to this frame, the rest of the handler is skipped along with it
+        task_exit(-(int)regs->interrupt - 1);
+    }
+
+    kprintf("Unhandled exception %d %s\n", regs->interrupt, g_Exceptions[regs->interrupt]);
+    
+    kprintf("  eax = 0x%lx  ebx = 0x%lx  ecx = 0x%lx  edx = 0x%lx  esi = 0x%lx  edi = 0x%lx\n",
+           regs->eax, regs->ebx, regs->ecx, regs->edx, regs->esi, regs->edi);
+
+    kprintf("  esp = 0x%lx  ebp = 0x%lx  eip = 0x%lx  eflags = 0x%lx\n",
+           regs->esp, regs->esp, regs->eip, regs->eflags);
+
+    kprintf("  cs = 0x%x  ds = 0x%x  es = 0x%x  fs = 0x%x  gs = 0x%x\n", 
+           regs->cs, regs->ds, regs->es, regs->fs, regs->gs);
+
+    uint32_t cr2;
+    uint32_t cr0;
+    uint32_t cr3;
+    __asm__ volatile ("mov %%cr2, %0" : "=r" (cr2));
+    __asm__ volatile ("mov %%cr0, %0" : "=r" (cr0));
+    __asm__ volatile ("mov %%cr3, %0" : "=r" (cr3));
+    kprintf("  cr2 = 0x%lx  cr0 = 0x%lx  cr3 = 0x%lx\n", cr2, cr0, cr3);
+
+    kprintf("  interrupt = 0x%x  errorcode = 0x%x\n", regs->interrupt, regs->error);
+
+    kprintf("KERNEL PANIC!\n");
+    cli();
+
+    for(;;) hlt();
+}
+
+registers_t* idt_default_handler(registers_t* regs)
+{
+    uint64_t start = rdtsc();
+    // the task the IRQ interrupted, kept for the exit event since a switch may be pending by then
+    uint32_t pid = 0;
+    if (regs->interrupt >= 32) {
+        struct task* task = current_task;
+        pid = task ? task->pid : 0;
+        sched_trace(TRACE_IRQ_ENTRY, pid, regs->interrupt);
+    }
+
     if (handlers[regs->interrupt] != nullptr)
         handlers[regs->interrupt](regs);
 
@@ -75,61 +156,93 @@ void idt_default_handler(registers_t* regs)
         kprintf("Unhandled interrupt %d!\n", regs->interrupt);
 
     else
-    {
-        if (regs->cs != 0x08) {
-            kprintf("Unhandled exception %d %s from usermode\n", regs->interrupt, g_Exceptions[regs->interrupt]);
-            kprintf("KERNEL PANIC!\n");
-            // TODO: Have the userspace manager kill it?
-            cli();
-            for(;;) hlt();
-        }
-
-        kprintf("Unhandled exception %d %s\n", regs->interrupt, g_Exceptions[regs->interrupt]);
-        
-        kprintf("  eax = 0x%lx  ebx = 0x%lx  ecx = 0x%lx  edx = 0x%lx  esi = 0x%lx  edi = 0x%lx\n",
-               regs->eax, regs->ebx, regs->ecx, regs->edx, regs->esi, regs->edi);
-
-        kprintf("  esp = 0x%lx  ebp = 0x%lx  eip = 0x%lx  eflags = 0x%lx\n",
-               regs->esp, regs->esp, regs->eip, regs->eflags);
-
-        kprintf("  cs = 0x%x  ds = 0x%x  es = 0x%x  fs = 0x%x  gs = 0x%x\n", 
-               regs->cs, regs->ds, regs->es, regs->fs, regs->gs);
+        idt_unhandled_exception(regs);
 
-        uint32_t cr2;
-        uint32_t cr0;
-        uint32_t cr3;
-        __asm__ volatile ("mov %%cr2, %0" : "=r" (cr2));
-        __asm__ volatile ("mov %%cr0, %0" : "=r" (cr0));
-        __asm__ volatile ("mov %%cr3, %0" : "=r" (cr3));
-        kprintf("  cr2 = 0x%lx  cr0 = 0x%lx  cr3 = 0x%lx\n", cr2, cr0, cr3);
+    // the task may have been preempted and moved to another CPU while the handler ran with interrupts enabled
+    struct cpu* cpu = this_cpu();
 
-        kprintf("  interrupt = 0x%x  errorcode = 0x%x\n", regs->interrupt, regs->error);
+    irq_stat_t* stat = &irq_stats[cpu->id][regs->interrupt];
+    stat->count++;
+    // a syscall may sleep on a lock or a disk, the time it spent switched out isn't dispatch cost
+    if (regs->interrupt != SYSCALL_VECTOR)
+    {
+        uint64_t cycles = rdtsc() - start;
+        stat->cycles += cycles;
+        if (cycles > stat->max_cycles)
+            stat->max_cycles = cycles;
+    }
 
-        kprintf("KERNEL PANIC!\n");
-        cli();
+    if (regs->interrupt >= 32)
+        sched_trace(TRACE_IRQ_EXIT, pid, regs->interrupt);
 
-        for(;;) hlt();
-    }
+    registers_t* next_frame = cpu->switch_frame ? cpu->switch_frame : regs;
+    cpu->switch_frame = nullptr;
+    return next_frame;
 }
 void irq_default_handler(registers_t* regs)
 {
     int irq = regs->interrupt - PIC_REMAP_OFFSET;
-    
-    uint8_t pic_isr = pic_read_isr();
-    uint8_t pic_irr = pic_read_irqrr();
+
+    if (!ioapic_active && pic_is_spurious(irq))
+    {
+        // no EOI for the line that never was in service, the master did see the cascade of a slave spurious IRQ
+        if (irq == 15)
+            pic_sendeoi(2);
+        irq_stats[this_cpu()->id][regs->interrupt].spurious++;
+        return;
+    }
 
     if (irq_handlers[irq] != nullptr)
     {
         irq_handlers[irq](regs);
     }
-    else
+    else if (irq != 0)
     {
-        if (irq != 0)
-            kprintf("Unhandled IRQ %d  ISR=%x  IRR=%x...\n", irq, pic_isr, pic_irr);
-        // Stupid message
+        // only worth the port I/O when something went wrong
+        if (ioapic_active)
+            kprintf("Unhandled IRQ %d\n", irq);
+        else
+            kprintf("Unhandled IRQ %d  ISR=%x  IRR=%x...\n", irq, pic_read_isr(), pic_read_irqrr());
     }
 
-    pic_sendeoi(irq);
+    irq_eoi(irq);
+}
+
+void irq_eoi(int irq)
+{
+    if (ioapic_active)
+        lapic_eoi();
+    else
+        pic_sendeoi(irq);
+}
+
+void irq_mask(int irq)
+{
+    if (ioapic_active)
+        ioapic_mask(irq);
+    else
+        pic_mask(irq);
+}
+
+void irq_unmask(int irq)
+{
+    if (ioapic_active)
+        ioapic_unmask(irq);
+    else
+        pic_unmask(irq);
+}
+
+void idt_get_stats(int vector, irq_stat_t* out)
+{
+    memset(out, 0, sizeof(irq_stat_t));
+    for (uint32_t i = 0; i < cpu_count; i++) {
+        irq_stat_t* stat = &irq_stats[i][vector];
+        out->count += stat->count;
+        out->cycles += stat->cycles;
+        out->spurious += stat->spurious;
+        if (stat->max_cycles > out->max_cycles)
+            out->max_cycles = stat->max_cycles;
+    }
 }
 
 void idt_set_gate(int interrupt, void* base, uint16_t segmentDescriptor, uint8_t flags)
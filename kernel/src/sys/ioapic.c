@@ -0,0 +1,126 @@
+#include <sys/ioapic.h>
+#include <sys/mp.h>
+#include <sys/apic.h>
+#include <sys/pic.h>
+#include <sys/mm/vmm.h>
+#include <proc/spinlock.h>
+#include <kprintf>
+#include <string.h>
+
+struct ioapic {
+    uint8_t id;
+    volatile uint32_t* base;
+    uint32_t pins;
+};
+
+static struct ioapic ioapics[MP_MAX_IOAPICS];
+static uint32_t ioapic_count = 0;
+
+// Where each ISA IRQ ends up, filled in by ioapic_init
+static struct {
+    struct ioapic* ioapic;
+    uint8_t pin;
+} isa_routes[MP_ISA_IRQS];
+
+bool ioapic_active = false;
+// Register accesses go through the select/window pair
+static spinlock_t ioapic_lock = SPINLOCK_INIT;
+
+static uint32_t ioapic_read(struct ioapic* ioapic, uint8_t reg) {
+    ioapic->base[IOAPIC_REG_SELECT / 4] = reg;
+    return ioapic->base[IOAPIC_REG_WINDOW / 4];
+}
+
+static void ioapic_write(struct ioapic* ioapic, uint8_t reg, uint32_t value) {
+    ioapic->base[IOAPIC_REG_SELECT / 4] = reg;
+    ioapic->base[IOAPIC_REG_WINDOW / 4] = value;
+}
+
+static struct ioapic* ioapic_by_id(uint8_t id) {
+    for (uint32_t i = 0; i < ioapic_count; i++) {
+        if (ioapics[i].id == id) return &ioapics[i];
+    }
+    return nullptr;
+}
+
+// MP interrupt flags, 0 in either field means "conforms to the bus" which is active high, edge for ISA
+static uint32_t redirection_flags(uint16_t flags) {
+    uint32_t redirection = 0;
+    if ((flags & 0x3) == 0x3) redirection |= IOAPIC_REDIR_ACTIVE_LOW;
+    if (((flags >> 2) & 0x3) == 0x3) redirection |= IOAPIC_REDIR_LEVEL;
+    return redirection;
+}
+
+static bool pin_claimed(struct ioapic* ioapic, uint8_t pin) {
+    for (int irq = 0; irq < MP_ISA_IRQS; irq++) {
+        if (isa_routes[irq].ioapic == ioapic && isa_routes[irq].pin == pin) return true;
+    }
+    return false;
+}
+
+static void route_isa_irq(int irq, struct ioapic* ioapic, uint8_t pin, uint32_t flags, uint8_t apic_id, uint8_t vector_base) {
+    if (!ioapic || pin >= ioapic->pins) return;
+
+    isa_routes[irq].ioapic = ioapic;
+    isa_routes[irq].pin = pin;
+
+    // everything starts unmasked, just like the PIC after pic_init
+    ioapic_write(ioapic, IOAPIC_REDIRECTION + pin * 2 + 1, (uint32_t)apic_id << 24);
+    ioapic_write(ioapic, IOAPIC_REDIRECTION + pin * 2, (vector_base + irq) | flags);
+}
+
+bool ioapic_init(uint8_t apic_id, uint8_t vector_base) {
+    if (!lapic || !mp_info.found || mp_info.ioapic_count == 0) return false;
+
+    for (uint32_t i = 0; i < mp_info.ioapic_count; i++) {
+        uintptr_t virt = IOAPIC_VIRT_BASE + i * PAGE_SIZE;
+        vmm_map_page(&kernel_page_directory, virt, PAGE_SIZE, mp_info.ioapics[i].address & ~0xFFF, PAGE_PRESENT | PAGE_RW | PAGE_CACHE_DISABLE);
+
+        struct ioapic* ioapic = &ioapics[ioapic_count++];
+        ioapic->id = mp_info.ioapics[i].id;
+        ioapic->base = (volatile uint32_t*)(virt + (mp_info.ioapics[i].address & 0xFFF));
+        ioapic->pins = ((ioapic_read(ioapic, IOAPIC_VERSION) >> 16) & 0xFF) + 1;
+
+        for (uint32_t pin = 0; pin < ioapic->pins; pin++) {
+            ioapic_write(ioapic, IOAPIC_REDIRECTION + pin * 2, IOAPIC_REDIR_MASKED);
+            ioapic_write(ioapic, IOAPIC_REDIRECTION + pin * 2 + 1, 0);
+        }
+    }
+
+    // entries the MP table has first, so the guesses below can't take a pin an override already claimed
+    for (int irq = 0; irq < MP_ISA_IRQS; irq++) {
+        struct mp_isa_irq* isa = &mp_info.isa_irqs[irq];
+        if (isa->present) route_isa_irq(irq, ioapic_by_id(isa->ioapic_id), isa->pin, redirection_flags(isa->flags), apic_id, vector_base);
+    }
+
+    // without an entry the IRQ is wired to the same pin of the first IO APIC. IRQ2 is the cascade, it never fires
+    // and its pin usually carries IRQ0 (QEMU and SeaBIOS don't list it at all).
+    for (int irq = 0; irq < MP_ISA_IRQS; irq++) {
+        if (irq == 2 || mp_info.isa_irqs[irq].present || pin_claimed(&ioapics[0], irq)) continue;
+        route_isa_irq(irq, &ioapics[0], irq, 0, apic_id, vector_base);
+    }
+
+    pic_disable();
+    ioapic_active = true;
+    kprintf("IOAPIC: %lu IO APICs, ISA IRQs routed to APIC %u\n", ioapic_count, apic_id);
+    return true;
+}
+
+static void ioapic_set_masked(int irq, bool masked) {
+    if (irq < 0 || irq >= MP_ISA_IRQS || !isa_routes[irq].ioapic) return;
+
+    struct ioapic* ioapic = isa_routes[irq].ioapic;
+    uint8_t reg = IOAPIC_REDIRECTION + isa_routes[irq].pin * 2;
+    uint32_t flags = spin_lock_irqsave(&ioapic_lock);
+    uint32_t entry = ioapic_read(ioapic, reg);
+    ioapic_write(ioapic, reg, masked ? (entry | IOAPIC_REDIR_MASKED) : (entry & ~IOAPIC_REDIR_MASKED));
+    spin_unlock_irqrestore(&ioapic_lock, flags);
+}
+
+void ioapic_mask(int irq) {
+    ioapic_set_masked(irq, true);
+}
+
+void ioapic_unmask(int irq) {
+    ioapic_set_masked(irq, false);
+}
@@ -1,6 +1,7 @@
 [bits 32]
 section .text
 extern idt_default_handler
+extern idt_finish_switch
 
 ; cpu pushes to the stack: ss, esp, eflags, cs, eip
 
@@ -39,7 +40,15 @@ isr_common:
     mov eax, idt_default_handler
     call eax
 
-    pop eax
+    ; idt_default_handler returns the frame to resume, which lives on another
+    ; task's kernel stack when the scheduler switched
+    mov ebx, [esp]
+    mov esp, eax
+    cmp eax, ebx
+    je .resume
+    call idt_finish_switch
+
+.resume:
     pop gs
     pop fs
     pop es
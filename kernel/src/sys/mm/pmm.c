@@ -1,6 +1,8 @@
 #include <sys/mm/pmm.h>
+#include <sys/mm/vmm.h>
 #include <string.h>
 #include <kprintf>
+#include <proc/spinlock.h>
 
 #define PAGE_SIZE 4096
 #define BITMAP_SIZE(memory_size) ((memory_size) / PAGE_SIZE / 8)
@@ -13,6 +15,9 @@ struct ultra_memory_map_attribute* pmm_memory_map;
 uint8_t* bitmap;
 size_t total_pages;
 size_t bitmap_size;
+static spinlock_t pmm_lock = SPINLOCK_INIT;
+static pmm_shrinker_t shrinkers[PMM_MAX_SHRINKERS];
+static size_t shrinker_count;
 
 static inline void set_bit(size_t bit) {
     bitmap[bit / 8] |= (1 << (bit % 8));
@@ -95,6 +100,10 @@ void pmm_init(struct ultra_boot_context* ctx) {
                 if (page_index >= bitmap_start_page && page_index < bitmap_end_page) {
                     continue;
                 }
+                // stays reserved, there is no higher half address to reach it through
+                if (page_index >= VMM_DIRECT_MAP_END / PAGE_SIZE) {
+                    break;
+                }
 
                 clear_bit(page_index);
             }
@@ -103,20 +112,43 @@ void pmm_init(struct ultra_boot_context* ctx) {
 }
 
 
-void* pmm_alloc() {
+void pmm_register_shrinker(pmm_shrinker_t shrinker) {
+    if (shrinker_count < PMM_MAX_SHRINKERS) shrinkers[shrinker_count++] = shrinker;
+}
+
+// Out of frames, asks the caches for `wanted` of them back. Called without pmm_lock, they free through pmm_free.
+static bool pmm_shrink(size_t wanted) {
+    size_t freed = 0;
+    for (size_t i = 0; i < shrinker_count && freed < wanted; i++) {
+        freed += shrinkers[i](wanted - freed);
+    }
+    return freed > 0;
+}
+
+static void* pmm_try_alloc() {
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
     for (size_t i = 0; i < total_pages; i++) {  
         if (!test_bit(i)) {
             set_bit(i);
+            spin_unlock_irqrestore(&pmm_lock, flags);
             return (void*)(i * PAGE_SIZE);
         }
     }
+    spin_unlock_irqrestore(&pmm_lock, flags);
     return NULL;
 }
 
-void* pmm_alloc_pages(size_t num_pages) {
+void* pmm_alloc() {
+    void* page = pmm_try_alloc();
+    if (!page && pmm_shrink(1)) page = pmm_try_alloc();
+    return page;
+}
+
+static void* pmm_try_alloc_pages(size_t num_pages) {
     size_t start_page = 0;
     size_t contiguous_count = 0;
 
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
     for (size_t i = 0; i < total_pages; i++) {
         if (!test_bit(i)) {
             if (contiguous_count == 0) {
@@ -128,26 +160,39 @@ void* pmm_alloc_pages(size_t num_pages) {
                 for (size_t j = 0; j < num_pages; j++) {
                     set_bit(start_page + j);
                 }
+                spin_unlock_irqrestore(&pmm_lock, flags);
                 return (void*)(start_page * PAGE_SIZE);
             }
         } else {
             contiguous_count = 0;
         }
     }
+    spin_unlock_irqrestore(&pmm_lock, flags);
     return NULL;  
 }
 
+void* pmm_alloc_pages(size_t num_pages) {
+    void* pages = pmm_try_alloc_pages(num_pages);
+    // freed frames needn't be next to each other, asking for the whole run twice over gives it a fair chance
+    if (!pages && pmm_shrink(num_pages * 2)) pages = pmm_try_alloc_pages(num_pages);
+    return pages;
+}
+
 void pmm_free_pages(void* address, size_t num_pages) {
     size_t start_page = (size_t)address / PAGE_SIZE;
 
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
     for (size_t i = 0; i < num_pages; i++) {
         clear_bit(start_page + i);
     }
+    spin_unlock_irqrestore(&pmm_lock, flags);
 }
 
 void pmm_free(void* ptr) {
     size_t page = (uintptr_t)ptr / PAGE_SIZE;
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
     clear_bit(page);
+    spin_unlock_irqrestore(&pmm_lock, flags);
 }
 
 void pmm_reclaim_bootloader_memory() {
@@ -20,6 +20,8 @@ static inline void set_page_entry(page_table_entry* entry, uint32_t addr, uint32
     entry->present = (flags & PAGE_PRESENT) ? 1 : 0;
     entry->readwrite = (flags & PAGE_RW) ? 1 : 0;
     entry->user = (flags & PAGE_USER) ? 1 : 0;
+    entry->writethru = (flags & PAGE_WRITETHROUGH) ? 1 : 0;
+    entry->cached = (flags & PAGE_CACHE_DISABLE) ? 1 : 0;
     entry->address = addr >> 12;
 }
 
@@ -45,7 +47,7 @@ void vmm_init_pd(vmm_context_t* page_directory) {
         __text_start, __text_end, __rodata_start, __rodata_end, __data_start, __data_end, __bss_start, __bss_end
     );
 
-    for (uint32_t addr = 0; addr < 0x40000000; addr += PAGE_SIZE) {
+    for (uint32_t addr = 0; addr < VMM_DIRECT_MAP_END; addr += PAGE_SIZE) {
         bool should_map = false;
         for (size_t i = 0; i < ULTRA_MEMORY_MAP_ENTRY_COUNT(pmm_memory_map->header); i++) {
             struct ultra_memory_map_entry* entry = &pmm_memory_map->entries[i];
@@ -99,26 +101,61 @@ bool vmm_map_page(vmm_context_t* pageDirectory, uint32_t vaddr, size_t size, uin
                 kprintf("Failed to allocate a new page table for vaddr=0x%x\n", vaddr);
                 return false;
             }
+            memset((uint8_t*)newPageTable + higher_half_base, 0, PAGE_SIZE);
 
-            set_page_entry((page_table_entry*)pageDirEntry, (uint32_t)newPageTable, PAGE_PRESENT | PAGE_RW);
+            set_page_entry((page_table_entry*)pageDirEntry, (uint32_t)newPageTable, PAGE_PRESENT | PAGE_RW | (flags & PAGE_USER));
+        } else if (flags & PAGE_USER) {
+            pageDirEntry->user = 1;
         }
 
-        PageTable* pageTable = (PageTable*)(pageDirEntry->address << 12);
+        // page tables are reached through the higher half so this keeps working once the boot identity map is gone
+        PageTable* pageTable = (PageTable*)((pageDirEntry->address << 12) + higher_half_base);
 
         page_table_entry* pageEntry = &pageTable->entries[pageTableIndex];
 
         set_page_entry(pageEntry, paddr, flags);
+        __asm__ volatile("invlpg (%0)" : :"r"(vaddr) : "memory");
 
         vaddr += PAGE_SIZE;
         paddr += PAGE_SIZE;
         size -= PAGE_SIZE;
-
-        __asm__ volatile("invlpg (%0)" : :"r"(vaddr) : "memory");
     }
 
     return true;
 }
 
+uintptr_t vmm_virt_to_phys(vmm_context_t* pageDirectory, uint32_t virtualAddress) {
+    page_dir_entry* pageDirEntry = &pageDirectory->pd->entries[virtualAddress >> 22];
+    if (!is_page_present((page_table_entry*)pageDirEntry)) {
+        return 0;
+    }
+
+    PageTable* pageTable = (PageTable*)((pageDirEntry->address << 12) + higher_half_base);
+    page_table_entry* pageEntry = &pageTable->entries[(virtualAddress >> 12) & 0x03FF];
+    if (!is_page_present(pageEntry)) {
+        return 0;
+    }
+    return (pageEntry->address << 12) | (virtualAddress & ~PAGE_MASK);
+}
+
+uint32_t vmm_page_flags(vmm_context_t* pageDirectory, uint32_t virtualAddress) {
+    page_dir_entry* pageDirEntry = &pageDirectory->pd->entries[virtualAddress >> 22];
+    if (!is_page_present((page_table_entry*)pageDirEntry)) {
+        return 0;
+    }
+
+    PageTable* pageTable = (PageTable*)((pageDirEntry->address << 12) + higher_half_base);
+    page_table_entry* pageEntry = &pageTable->entries[(virtualAddress >> 12) & 0x03FF];
+    if (!is_page_present(pageEntry)) {
+        return 0;
+    }
+
+    uint32_t flags = PAGE_PRESENT;
+    if (pageDirEntry->readwrite && pageEntry->readwrite) flags |= PAGE_RW;
+    if (pageDirEntry->user && pageEntry->user) flags |= PAGE_USER;
+    return flags;
+}
+
 static const char pnp_text[] = "Page not present at 0x%x\n";
 bool vmm_unmap_page(vmm_context_t* pageDirectory, uint32_t virtualAddress) {
     uint32_t vaddr = ROUND_DOWN_TO_PAGE(virtualAddress);
@@ -132,7 +169,7 @@ bool vmm_unmap_page(vmm_context_t* pageDirectory, uint32_t virtualAddress) {
         return false;
     }
 
-    PageTable* pageTable = (PageTable*)(pageDirEntry->address << 12);
+    PageTable* pageTable = (PageTable*)((pageDirEntry->address << 12) + higher_half_base);
     page_table_entry* pageEntry = &pageTable->entries[pageTableIndex];
 
     if (!is_page_present(pageEntry)) { 
@@ -147,4 +184,46 @@ bool vmm_unmap_page(vmm_context_t* pageDirectory, uint32_t virtualAddress) {
     );
 
     return true;
+}
+
+// Every kernel directory entry already exists after vmm_init_pd, so sharing them keeps the kernel half in sync
+bool vmm_create_pd(vmm_context_t* pageDirectory) {
+    void* frame = pmm_alloc();
+    if (!frame) {
+        return false;
+    }
+
+    pageDirectory->pd = (PageDirectory*)((uintptr_t)frame + higher_half_base);
+    pageDirectory->cr3 = (uintptr_t)frame;
+
+    uint32_t kernelDirIndex = higher_half_base >> 22;
+    memset(pageDirectory->pd, 0, kernelDirIndex * sizeof(page_dir_entry));
+    memcpy(&pageDirectory->pd->entries[kernelDirIndex], &kernel_page_directory.pd->entries[kernelDirIndex],
+           (1024 - kernelDirIndex) * sizeof(page_dir_entry));
+    return true;
+}
+
+// Releases every frame and page table below the higher half and the directory itself, the kernel half is shared and left alone
+void vmm_destroy_pd(vmm_context_t* pageDirectory) {
+    uint32_t kernelDirIndex = higher_half_base >> 22;
+
+    for (uint32_t pageDirIndex = 0; pageDirIndex < kernelDirIndex; pageDirIndex++) {
+        page_dir_entry* pageDirEntry = &pageDirectory->pd->entries[pageDirIndex];
+        if (!is_page_present((page_table_entry*)pageDirEntry)) {
+            continue;
+        }
+
+        uintptr_t tablePhys = pageDirEntry->address << 12;
+        PageTable* pageTable = (PageTable*)(tablePhys + higher_half_base);
+        for (uint32_t pageTableIndex = 0; pageTableIndex < 1024; pageTableIndex++) {
+            if (is_page_present(&pageTable->entries[pageTableIndex])) {
+                pmm_free((void*)(pageTable->entries[pageTableIndex].address << 12));
+            }
+        }
+        pmm_free((void*)tablePhys);
+    }
+
+    pmm_free((void*)((uintptr_t)pageDirectory->pd - higher_half_base));
+    pageDirectory->pd = nullptr;
+    pageDirectory->cr3 = 0;
 }
\ No newline at end of file
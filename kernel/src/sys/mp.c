@@ -0,0 +1,119 @@
+#include <sys/mp.h>
+#include <string.h>
+#include <kprintf>
+
+extern uintptr_t higher_half_base;
+
+struct mp_info mp_info;
+
+static bool checksum_ok(const void* data, uint32_t length) {
+    const uint8_t* bytes = data;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < length; i++)
+        sum += bytes[i];
+    return sum == 0;
+}
+
+static mp_floating_pointer_t* scan(uintptr_t physical_address, uint32_t length) {
+    for (uintptr_t addr = physical_address; addr < physical_address + length; addr += 16) {
+        mp_floating_pointer_t* fp = (mp_floating_pointer_t*)(addr + higher_half_base);
+        if (memcmp(fp->signature, "_MP_", 4) == 0 && checksum_ok(fp, fp->length * 16))
+            return fp;
+    }
+    return nullptr;
+}
+
+static mp_floating_pointer_t* find_floating_pointer() {
+    uint16_t ebda_segment = *(uint16_t*)(0x40E + higher_half_base);
+    uint16_t base_memory_kb = *(uint16_t*)(0x413 + higher_half_base);
+
+    mp_floating_pointer_t* fp = nullptr;
+    if (ebda_segment)
+        fp = scan((uintptr_t)ebda_segment << 4, 1024);
+    if (!fp && base_memory_kb)
+        fp = scan((uintptr_t)base_memory_kb * 1024 - 1024, 1024);
+    if (!fp)
+        fp = scan(0xF0000, 0x10000);
+    return fp;
+}
+
+bool mp_parse() {
+    memset(&mp_info, 0, sizeof(mp_info));
+
+    mp_floating_pointer_t* fp = find_floating_pointer();
+    if (!fp) {
+        kprintf("MP: no floating pointer structure, assuming a uniprocessor system\n");
+        return false;
+    }
+    if (fp->config_table == 0) {
+        // Default configurations aren't worth supporting, nothing QEMU or real boards we care about use them
+        kprintf("MP: default configuration %d not supported\n", fp->features[0]);
+        return false;
+    }
+
+    mp_config_table_t* table = (mp_config_table_t*)(fp->config_table + higher_half_base);
+    if (memcmp(table->signature, "PCMP", 4) != 0 || !checksum_ok(table, table->length)) {
+        kprintf("MP: bad configuration table at 0x%lx\n", fp->config_table);
+        return false;
+    }
+
+    mp_info.lapic_address = table->lapic_address;
+
+    int isa_bus = -1;
+    uint8_t* entry = (uint8_t*)(table + 1);
+    for (uint32_t i = 0; i < table->entry_count; i++) {
+        switch (*entry) {
+            case MP_ENTRY_PROCESSOR: {
+                mp_processor_entry_t* cpu = (mp_processor_entry_t*)entry;
+                if ((cpu->flags & MP_CPU_ENABLED) && mp_info.cpu_count < MP_MAX_CPUS) {
+                    mp_info.cpu_apic_ids[mp_info.cpu_count++] = cpu->lapic_id;
+                    if (cpu->flags & MP_CPU_BSP)
+                        mp_info.bsp_apic_id = cpu->lapic_id;
+                }
+                entry += sizeof(mp_processor_entry_t);
+                break;
+            }
+            case MP_ENTRY_BUS: {
+                mp_bus_entry_t* bus = (mp_bus_entry_t*)entry;
+                if (memcmp(bus->bus_type, "ISA", 3) == 0)
+                    isa_bus = bus->bus_id;
+                entry += sizeof(mp_bus_entry_t);
+                break;
+            }
+            case MP_ENTRY_IOAPIC: {
+                mp_ioapic_entry_t* ioapic = (mp_ioapic_entry_t*)entry;
+                if ((ioapic->flags & 1) && mp_info.ioapic_count < MP_MAX_IOAPICS) {
+                    mp_info.ioapics[mp_info.ioapic_count].id = ioapic->id;
+                    mp_info.ioapics[mp_info.ioapic_count].address = ioapic->address;
+                    mp_info.ioapic_count++;
+                }
+                entry += sizeof(mp_ioapic_entry_t);
+                break;
+            }
+            case MP_ENTRY_IO_INTERRUPT: {
+                // bus entries always come first so the ISA bus id is known by now
+                mp_interrupt_entry_t* irq = (mp_interrupt_entry_t*)entry;
+                if (irq->interrupt_type == 0 && irq->source_bus == isa_bus && irq->source_irq < MP_ISA_IRQS) {
+                    struct mp_isa_irq* isa = &mp_info.isa_irqs[irq->source_irq];
+                    isa->present = true;
+                    isa->ioapic_id = irq->ioapic_id;
+                    isa->pin = irq->ioapic_pin;
+                    isa->flags = irq->flags;
+                }
+                entry += sizeof(mp_interrupt_entry_t);
+                break;
+            }
+            case MP_ENTRY_LOCAL_INTERRUPT:
+                entry += sizeof(mp_interrupt_entry_t);
+                break;
+            default:
+                kprintf("MP: unknown entry type %d, stopping\n", *entry);
+                i = table->entry_count;
+                break;
+        }
+    }
+
+    mp_info.found = mp_info.cpu_count > 0;
+    kprintf("MP: %lu CPUs, %lu IO APICs, LAPIC at 0x%lx\n", mp_info.cpu_count, mp_info.ioapic_count, mp_info.lapic_address);
+    return mp_info.found;
+}
@@ -90,12 +90,20 @@ uint16_t pic_read_irqrr()
 {
     outb(PIC1_COMMAND_PORT, PIC_CMD_READ_IRR);
     outb(PIC2_COMMAND_PORT, PIC_CMD_READ_IRR);
-    return ((uint16_t)inb(PIC2_COMMAND_PORT)) | (((uint16_t)inb(PIC2_COMMAND_PORT)) << 8);
+    return ((uint16_t)inb(PIC1_COMMAND_PORT)) | (((uint16_t)inb(PIC2_COMMAND_PORT)) << 8);
 }
 
 uint16_t pic_read_isr()
 {
     outb(PIC1_COMMAND_PORT, PIC_CMD_READ_ISR);
     outb(PIC2_COMMAND_PORT, PIC_CMD_READ_ISR);
-    return ((uint16_t)inb(PIC2_COMMAND_PORT)) | (((uint16_t)inb(PIC2_COMMAND_PORT)) << 8);
+    return ((uint16_t)inb(PIC1_COMMAND_PORT)) | (((uint16_t)inb(PIC2_COMMAND_PORT)) << 8);
+}
+
+// IRQ7/15 is spurious when the PIC has nothing in service for it, the request went away before the CPU acknowledged it
+bool pic_is_spurious(int irq)
+{
+    if (irq != 7 && irq != 15)
+        return false;
+    return !(pic_read_isr() & (1 << irq));
 }
\ No newline at end of file
@@ -0,0 +1,170 @@
+#include <sys/smp.h>
+#include <sys/syscall.h>
+#include <sys/mm/pmm.h>
+#include <sys/mm/vmm.h>
+#include <proc/sched.h>
+#include <kheap.h>
+#include <kprintf>
+#include <string.h>
+#include <io.h>
+
+extern uintptr_t higher_half_base;
+
+extern uint8_t ap_trampoline_start[];
+extern uint8_t ap_trampoline_end[];
+extern uint8_t ap_trampoline_far_jump[];
+extern uint8_t ap_trampoline_base[];
+extern uint8_t ap_trampoline_gdtr[];
+extern uint8_t ap_trampoline_cr3[];
+extern uint8_t ap_trampoline_stack[];
+extern uint8_t ap_trampoline_entry[];
+extern uint8_t ap_trampoline_cpu[];
+
+#define TRAMPOLINE_OFFSET(label) ((uintptr_t)(label) - (uintptr_t)ap_trampoline_start)
+// The protected mode entry sits right after the 6 byte operand of the far jump
+#define TRAMPOLINE_PROTECTED_OFFSET (TRAMPOLINE_OFFSET(ap_trampoline_far_jump) + 6)
+#define TRAMPOLINE_GDT_OFFSET (TRAMPOLINE_OFFSET(ap_trampoline_gdtr) - 24)
+
+struct cpu cpus[MAX_CPUS];
+uint32_t cpu_count = 1;
+volatile bool smp_active = false;
+uint8_t apic_to_cpu[256];
+
+// GDT, its pointer and the TSS of an application processor live in one allocation
+struct cpu_tables {
+    gdt_t gdt;
+    gdt_pointer_t gdt_ptr;
+    tss_t tss;
+};
+
+// io_wait is an ISA bus cycle, about a microsecond
+static void udelay(uint32_t microseconds) {
+    while (microseconds--) io_wait();
+}
+
+static void trampoline_patch(uintptr_t trampoline, void* label, uint32_t value) {
+    *(uint32_t*)(trampoline + higher_half_base + TRAMPOLINE_OFFSET(label)) = value;
+}
+
+[[noreturn]] static void ap_main(struct cpu* cpu) {
+    uint32_t esp;
+    __asm__ volatile ("mov %%esp, %0" : "=r" (esp));
+    gdt_setup(cpu->gdt, cpu->gdt_ptr, cpu->tss, esp);
+    idt_load();
+    lapic_init();
+
+    syscall_init_cpu(cpu);
+    sched_init_cpu(cpu);
+    cpu->online = true;
+
+    // the first reschedule IPI moves us onto the idle task's stack
+    for (;;) {
+        sti();
+        hlt();
+    }
+}
+
+// False only if nothing was sent, otherwise the AP may come up at any time later and cpu belongs to it for good
+static bool boot_ap(struct cpu* cpu, uintptr_t trampoline) {
+    struct cpu_tables* tables = kmalloc(sizeof(struct cpu_tables));
+    uint8_t* stack = kmalloc(STACK_SIZE);
+    if (!tables || !stack) {
+        kfree(tables);
+        kfree(stack);
+        return false;
+    }
+    cpu->gdt = &tables->gdt;
+    cpu->gdt_ptr = &tables->gdt_ptr;
+    cpu->tss = &tables->tss;
+
+    trampoline_patch(trampoline, ap_trampoline_stack, (uint32_t)(stack + STACK_SIZE));
+    trampoline_patch(trampoline, ap_trampoline_cpu, (uint32_t)cpu);
+
+    lapic_send_ipi(cpu->apic_id, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT | LAPIC_ICR_LEVEL);
+    udelay(200);
+    lapic_send_ipi(cpu->apic_id, LAPIC_ICR_INIT | LAPIC_ICR_LEVEL);
+    udelay(10000);
+
+    for (int attempt = 0; attempt < 2 && !cpu->online; attempt++) {
+        lapic_send_ipi(cpu->apic_id, LAPIC_ICR_STARTUP | (trampoline >> 12));
+        for (int waited = 0; waited < 1000 && !cpu->online; waited++) udelay(100);
+    }
+
+    if (!cpu->online) {
+        // the AP may still be running on these if it came up late, better to leak them
+        kprintf("smp: cpu with apic id %u did not respond\n", cpu->apic_id);
+    }
+    return true;
+}
+
+static void smp_init_bsp() {
+    cpus[0].id = 0;
+    cpus[0].online = true;
+    cpus[0].gdt = &gdt;
+    cpus[0].gdt_ptr = &gdt_ptr;
+    cpus[0].tss = &tss;
+}
+
+void smp_init() {
+    smp_init_bsp();
+
+    if (!mp_info.found || !lapic_supported()) {
+        kprintf("smp: no MP configuration or local APIC, running uniprocessor\n");
+        return;
+    }
+
+    lapic_map(mp_info.lapic_address);
+    lapic_init();
+    lapic_timer_calibrate();
+    cpus[0].apic_id = lapic_id();
+    apic_to_cpu[cpus[0].apic_id] = 0;
+
+    if (mp_info.cpu_count < 2) return;
+
+    // SIPI can only start execution in the first megabyte
+    uintptr_t trampoline = (uintptr_t)pmm_alloc();
+    if (!trampoline || trampoline >= 0x100000) {
+        if (trampoline) pmm_free((void*)trampoline);
+        kprintf("smp: no free page below 1MiB for the AP trampoline\n");
+        return;
+    }
+
+    uint32_t size = ap_trampoline_end - ap_trampoline_start;
+    memcpy((void*)(trampoline + higher_half_base), ap_trampoline_start, size);
+    trampoline_patch(trampoline, ap_trampoline_far_jump, trampoline + TRAMPOLINE_PROTECTED_OFFSET);
+    trampoline_patch(trampoline, ap_trampoline_base, trampoline);
+    // the gdtr limit is a word, the base follows it
+    *(uint32_t*)(trampoline + higher_half_base + TRAMPOLINE_OFFSET(ap_trampoline_gdtr) + 2) = trampoline + TRAMPOLINE_GDT_OFFSET;
+    trampoline_patch(trampoline, ap_trampoline_cr3, kernel_page_directory.cr3);
+    trampoline_patch(trampoline, ap_trampoline_entry, (uint32_t)ap_main);
+
+    // the APs enable paging while still executing from the trampoline's physical address
+    vmm_map_page(&kernel_page_directory, trampoline, PAGE_SIZE, trampoline, PAGE_PRESENT | PAGE_RW);
+
+    smp_active = true;
+    bool late = false;
+    for (uint32_t i = 0; i < mp_info.cpu_count && cpu_count < MAX_CPUS; i++) {
+        uint8_t apic_id = mp_info.cpu_apic_ids[i];
+        if (apic_id == cpus[0].apic_id) continue;
+
+        struct cpu* cpu = &cpus[cpu_count];
+        memset(cpu, 0, sizeof(struct cpu));
+        cpu->id = cpu_count;
+        cpu->apic_id = apic_id;
+        apic_to_cpu[apic_id] = cpu->id;
+
+        // a slot that got a SIPI is never handed to another AP, an offline one is skipped by everything else
+        if (!boot_ap(cpu, trampoline)) continue;
+        late |= !cpu->online;
+        cpu_count++;
+    }
+
+    // an AP that didn't answer may still be about to run the trampoline, so its page stays. Otherwise
+    // unmapping frees the frame along with the identity mapping.
+    if (!late) vmm_unmap_page(&kernel_page_directory, trampoline);
+    smp_active = cpu_count > 1;
+
+    uint32_t online = 0;
+    for (uint32_t i = 0; i < cpu_count; i++) online += cpus[i].online;
+    kprintf("smp: %u cpus online\n", online);
+}
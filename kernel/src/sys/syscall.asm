@@ -0,0 +1,63 @@
+[bits 32]
+section .text
+extern idt_default_handler
+extern idt_finish_switch
+global sysenter_entry
+
+; SYSENTER_ESP points at this CPU's TSS esp0 slot, the scheduler keeps that on the current
+; task's kernel stack. The frame built here is the one int 0x80 would have pushed, so the
+; dispatcher, the scheduler and a later iret back into the task all see the same layout.
+sysenter_entry:
+    mov esp, [esp]
+
+    push 0x23                   ; ss
+    push ecx                    ; user esp
+    pushfd
+    or dword [esp], 0x200       ; sysenter cleared IF, the task had it set
+    push 0x1B                   ; cs
+    push edx                    ; eip
+    push 0                      ; error
+    push 0x80                   ; interrupt
+    pusha
+    push ds
+    push es
+    push fs
+    push gs
+
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+
+    mov eax, esp
+    push eax
+
+    mov eax, idt_default_handler
+    call eax
+
+    mov ebx, [esp]
+    mov esp, eax
+    cmp eax, ebx
+    je .sysexit
+
+    ; the syscall switched tasks, whatever runs next is resumed the way isr_common does it
+    call idt_finish_switch
+    pop gs
+    pop fs
+    pop es
+    pop ds
+    popa
+    add esp, 8
+    iret
+
+.sysexit:
+    pop gs
+    pop fs
+    pop es
+    pop ds
+    popa
+    mov edx, [esp + 8]          ; eip
+    mov ecx, [esp + 20]         ; user esp
+    sti                         ; takes effect after sysexit, nothing can interrupt in between
+    sysexit
@@ -0,0 +1,239 @@
+#include <sys/syscall.h>
+#include <sys/smp.h>
+#include <sys/gdt.h>
+#include <proc/sched.h>
+#include <proc/vfs.h>
+#include <proc/file.h>
+#include <proc/uaccess.h>
+#include <kheap.h>
+#include <fshell/framebuffer.h>
+#include <sys/mm/vmm.h>
+#include <io.h>
+#include <kprintf>
+#include <string.h>
+
+#define MSR_SYSENTER_CS  0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
+// open hands out fds from here on, the ones below are the console until something is dup'ed onto them
+#define SYSCALL_FIRST_FD 3
+
+extern void sysenter_entry();
+extern void *isr_table[];
+
+bool sysenter_supported = false;
+
+typedef int32_t (*syscall_t)(uint32_t arg0, uint32_t arg1, uint32_t arg2);
+
+// Copies the iovec array in and clips it to SYSCALL_IO_MAX bytes, then checks every buffer that is left.
+// Returns how many bytes the buffers cover or -1.
+static int32_t copy_iov(struct vfs_iovec* iov, uint32_t user_iov, uint32_t count, bool write) {
+    if (count > VFS_IOV_MAX || !copy_from_user(iov, user_iov, count * sizeof(struct vfs_iovec))) return -1;
+
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (iov[i].length > SYSCALL_IO_MAX - total) iov[i].length = SYSCALL_IO_MAX - total;
+        if (!user_access_ok((uint32_t)iov[i].base, iov[i].length, write)) return -1;
+        total += iov[i].length;
+    }
+    return total;
+}
+
+static void console_write(const char* buffer, uint32_t size) {
+    for (uint32_t i = 0; i < size; i++) putc(buffer[i]);
+}
+
+static int32_t sys_exit(uint32_t code, uint32_t, uint32_t) {
+    task_exit((int)code);
+}
+
+static int32_t sys_yield(uint32_t, uint32_t, uint32_t) {
+    yield();
+    return 0;
+}
+
+static int32_t sys_sleep(uint32_t ms, uint32_t, uint32_t) {
+    sched_sleep(ms);
+    return 0;
+}
+
+static int32_t sys_open(uint32_t user_path, uint32_t flags, uint32_t) {
+    char path[SYSCALL_MAX_PATH];
+    if (!copy_string_from_user(path, user_path, SYSCALL_MAX_PATH)) return -1;
+    if (!(flags & (VFS_O_READ | VFS_O_WRITE))) return -1;
+
+    struct vfs_file* file = vfs_file_open(path, flags);
+    if (!file) return -1;
+
+    int fd = fd_install(current_task, file, SYSCALL_FIRST_FD);
+    if (fd < 0) vfs_file_put(file);
+    return fd;
+}
+
+static int32_t sys_close(uint32_t fd, uint32_t, uint32_t) {
+    return fd_close(current_task, (int)fd);
+}
+
+// The file is read into a kernel buffer and only then scattered to the task, user memory is never touched
+// while the file or its pages are locked
+static int32_t read_iov(uint32_t fd, const struct vfs_iovec* iov, uint32_t count, uint32_t total) {
+    struct vfs_file* file = fd_get(current_task, (int)fd);
+    if (!file) return -1;
+    if (total == 0) return 0;
+
+    uint8_t* bounce = kmalloc(total);
+    if (!bounce) return -1;
+    int64_t done = vfs_file_read(file, bounce, total);
+
+    uint32_t copied = 0;
+    for (uint32_t i = 0; i < count && done > 0 && copied < done; i++) {
+        uint32_t length = iov[i].length < done - copied ? iov[i].length : done - copied;
+        if (!copy_to_user((uint32_t)iov[i].base, bounce + copied, length)) done = -1;
+        copied += length;
+    }
+    kfree(bounce);
+    return (int32_t)done;
+}
+
+// Gathers the task's buffers first, the other way around from read_iov
+static int32_t write_iov(uint32_t fd, const struct vfs_iovec* iov, uint32_t count, uint32_t total) {
+    struct vfs_file* file = fd_get(current_task, (int)fd);
+    // stdout and stderr, as long as nothing was dup'ed over them
+    if (!file && fd != 1 && fd != 2) return -1;
+    if (total == 0) return 0;
+
+    uint8_t* bounce = kmalloc(total);
+    if (!bounce) return -1;
+    uint32_t gathered = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (!copy_from_user(bounce + gathered, (uint32_t)iov[i].base, iov[i].length)) {
+            kfree(bounce);
+            return -1;
+        }
+        gathered += iov[i].length;
+    }
+
+    int32_t done = total;
+    if (file) done = (int32_t)vfs_file_write(file, bounce, total);
+    else console_write((const char*)bounce, total);
+    kfree(bounce);
+    return done;
+}
+
+static int32_t sys_read(uint32_t fd, uint32_t buffer, uint32_t size) {
+    struct vfs_iovec iov = { (void*)buffer, size < SYSCALL_IO_MAX ? size : SYSCALL_IO_MAX };
+    if (!user_access_ok(buffer, iov.length, true)) return -1;
+    return read_iov(fd, &iov, 1, iov.length);
+}
+
+static int32_t sys_write(uint32_t fd, uint32_t buffer, uint32_t size) {
+    struct vfs_iovec iov = { (void*)buffer, size < SYSCALL_IO_MAX ? size : SYSCALL_IO_MAX };
+    return write_iov(fd, &iov, 1, iov.length);
+}
+
+static int32_t sys_seek(uint32_t fd, uint32_t offset, uint32_t whence) {
+    struct vfs_file* file = fd_get(current_task, (int)fd);
+    if (!file) return -1;
+
+    // the offset is signed 32-bit on this side of the ABI, a file position past 2 GiB can't be reported back
+    return (int32_t)vfs_file_seek(file, (int32_t)offset, (int)whence, INT32_MAX);
+}
+
+static int32_t sys_dup(uint32_t fd, uint32_t, uint32_t) {
+    struct task* task = current_task;
+    struct vfs_file* file = fd_get(task, (int)fd);
+    if (!file) return -1;
+
+    // like open, the low fds are only ever replaced on purpose through dup2
+    int new_fd = fd_install(task, vfs_file_get(file), SYSCALL_FIRST_FD);
+    if (new_fd < 0) vfs_file_put(file);
+    return new_fd;
+}
+
+static int32_t sys_dup2(uint32_t fd, uint32_t target, uint32_t) {
+    struct task* task = current_task;
+    struct vfs_file* file = fd_get(task, (int)fd);
+    if (!file || target >= TASK_MAX_FILES) return -1;
+    if (fd == target) return (int32_t)target;
+
+    // whatever sat on target is closed first, its slot is free again afterwards
+    vfs_file_get(file);
+    fd_close(task, (int)target);
+    return fd_install(task, file, (int)target);
+}
+
+static int32_t sys_sync(uint32_t, uint32_t, uint32_t) {
+    return sync() == VFS_SUCCESS ? 0 : -1;
+}
+
+static int32_t sys_readv(uint32_t fd, uint32_t user_iov, uint32_t count) {
+    struct vfs_iovec iov[VFS_IOV_MAX];
+    int32_t total = copy_iov(iov, user_iov, count, true);
+    return total < 0 ? -1 : read_iov(fd, iov, count, total);
+}
+
+static int32_t sys_writev(uint32_t fd, uint32_t user_iov, uint32_t count) {
+    struct vfs_iovec iov[VFS_IOV_MAX];
+    int32_t total = copy_iov(iov, user_iov, count, false);
+    return total < 0 ? -1 : write_iov(fd, iov, count, total);
+}
+
+static const syscall_t syscall_table[SYSCALL_COUNT] = {
+    [SYS_EXIT] = sys_exit,
+    [SYS_YIELD] = sys_yield,
+    [SYS_SLEEP] = sys_sleep,
+    [SYS_OPEN] = sys_open,
+    [SYS_CLOSE] = sys_close,
+    [SYS_READ] = sys_read,
+    [SYS_WRITE] = sys_write,
+    [SYS_SEEK] = sys_seek,
+    [SYS_DUP] = sys_dup,
+    [SYS_READV] = sys_readv,
+    [SYS_WRITEV] = sys_writev,
+    [SYS_DUP2] = sys_dup2,
+    [SYS_SYNC] = sys_sync,
+};
+
+// Both entry paths end up here through idt_default_handler
+static void syscall_handler(registers_t* regs) {
+    if (regs->eax >= SYSCALL_COUNT) {
+        regs->eax = (uint32_t)-1;
+        return;
+    }
+
+    // syscalls may block and take a while, only the dispatch around them runs with interrupts off
+    sti();
+    regs->eax = syscall_table[regs->eax](regs->ebx, regs->esi, regs->edi);
+    cli();
+}
+
+static bool cpu_has_sep() {
+    uint32_t eax, ebx, ecx, edx;
+    __asm__ volatile ("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+    if (!(edx & (1 << 11))) return false;
+
+    // the Pentium Pro reports SEP without actually supporting it
+    uint32_t family = (eax >> 8) & 0xF, model = (eax >> 4) & 0xF, stepping = eax & 0xF;
+    return !(family == 6 && model < 3 && stepping < 3);
+}
+
+void syscall_init_cpu(struct cpu* cpu) {
+    if (!sysenter_supported) return;
+
+    // sysexit derives the user selectors from this one, which is why the GDT keeps them right after the kernel ones
+    write_msr(MSR_SYSENTER_CS, GDT_KERNEL_CODE_SELECTOR);
+    write_msr(MSR_SYSENTER_ESP, (uint32_t)&cpu->tss->esp0);
+    write_msr(MSR_SYSENTER_EIP, (uint32_t)sysenter_entry);
+}
+
+void syscall_init() {
+    // the only gate ring 3 may raise itself
+    idt_set_gate(SYSCALL_VECTOR, isr_table[SYSCALL_VECTOR], GDT_KERNEL_CODE_SELECTOR, IDT_FLAG_RING3 | IDT_FLAG_GATE_32BIT_INT);
+    idt_enable_gate(SYSCALL_VECTOR);
+    idt_register_handler(SYSCALL_VECTOR, syscall_handler);
+
+    sysenter_supported = cpu_has_sep();
+    syscall_init_cpu(this_cpu());
+    kprintf("syscall: int 0x%x%s\n", SYSCALL_VECTOR, sysenter_supported ? " and sysenter" : "");
+}